@@ -1,46 +1,255 @@
 #pragma once
 #include <AccelEngine/body.h>
+#include <AccelEngine/BroadPhase.h>
+#include <AccelEngine/ThreadPool.h>
+#include <cstdint>
 #include <vector>
 
 namespace AccelEngine
 {
+    // Nodes live in one array in depth-first order, so an internal node's left
+    // child is always the next node and children always come after their parent.
     struct BVHNode
     {
         Vector2 minAABB;
         Vector2 maxAABB;
 
-        RigidBody* body;    
-        BVHNode* left;
-        BVHNode* right;
+        int32_t left;
+        int32_t right;
+        int32_t body; // index into the leaf body list, -1 for internal nodes
 
-        BVHNode()
-            : body(nullptr), left(nullptr), right(nullptr),
-              minAABB(1e9f, 1e9f), maxAABB(-1e9f, -1e9f) {}
+        // OR of every leaf's filter bits below this node, see LeafFilter in BroadPhase.h
+        uint32_t categoryBits;
+        uint32_t maskBits;
+
+        bool isLeaf() const { return body >= 0; }
+    };
+
+    // 4-wide node collapsed from the binary tree. Child bounds are stored as
+    // structure of arrays so one SIMD compare tests a box against all four.
+    struct alignas(16) QBVHNode
+    {
+        float minX[4];
+        float minY[4];
+        float maxX[4];
+        float maxY[4];
+
+        // filter bits per slot, 0 in unused slots
+        uint32_t category[4];
+        uint32_t mask[4];
+
+        // >= 0 is a wide node index, < 0 is ~leaf body index
+        int32_t child[4];
+        int32_t count; // used slots, unused ones have inverted bounds that never overlap
+
+        static bool isLeaf(int32_t c) { return c < 0; }
+        static int32_t leafIndex(int32_t c) { return ~c; }
+    };
+
+    // One flattened tree plus the bodies its leaves point at
+    struct BVHHierarchy
+    {
+        std::vector<BVHNode> nodes;
+        std::vector<QBVHNode> wideNodes; // parents before children, like nodes
+
+        // bodies in leaf order, also used as scratch space while building
+        std::vector<RigidBody*> leafBodies;
+
+        bool empty() const { return nodes.empty(); }
+        void clear()
+        {
+            nodes.clear();
+            wideNodes.clear();
+            leafBodies.clear();
+        }
+    };
+
+    enum class BVHBuildMode
+    {
+        MEDIAN,     // sort on the longest axis and split in the middle
+        BINNED_SAH, // bin centroids and pick the cheapest surface area split
+        LBVH        // radix sort by Morton code and split where the top differing bit flips
     };
 
-    class BVHTree
+    // Static bodies (see RigidBody::isStatic) go into their own tree that is only
+    // rebuilt when the set of static bodies changes, everything else is rebuilt
+    // by build() and refit by refit().
+    class BVHTree : public BroadPhase
     {
     public:
-        BVHNode* root;
+        static constexpr int32_t nullNode = -1;
+        static constexpr int minSAHBins = 8;
+        static constexpr int maxSAHBins = 32;
+
+        // findPairs splits the traversal into about this many independent tasks
+        static constexpr int pairTaskTarget = 64;
+        // LBVH builds split the range into subtrees of at most this many bodies per task
+        static constexpr int lbvhTaskSize = 1024;
+
+        BVHBuildMode buildMode = BVHBuildMode::MEDIAN;
+        int sahBins = 16; // clamped to [minSAHBins, maxSAHBins]
+
+        // runs the pair tasks on these threads, null runs them on the caller.
+        // the pair order only depends on the tree, never on the thread count
+        ThreadPool* threadPool = nullptr;
+        // below this many dynamic bodies findPairs does one plain traversal
+        int parallelMinBodies = 4096;
+
+        // collapse each build into 4-wide nodes and run findPairs and query on those
+        bool wideNodes = true;
 
         BVHTree();
         ~BVHTree();
 
         void build(const std::vector<RigidBody*>& bodies);
+
+        // drops both trees but keeps the node capacity for the next build
         void destroy();
 
-        void findPairs(std::vector<std::pair<RigidBody*,RigidBody*>>& outPairs);
+        // updates dynamic node bounds from the current body AABBs, keeps the topology
+        void refit();
+
+        // forces a static rebuild on the next build, needed after moving or refiltering a static body by hand
+        void invalidateStatic() { staticDirty = true; }
+
+        // BroadPhase: rebuild once per step, refit every substep
+        void beginStep(const std::vector<RigidBody*>& bodies) override;
+        void update(const std::vector<RigidBody*>& bodies) override;
+        void clear() override { destroy(); }
 
-        void draw();
+        void findPairs(std::vector<std::pair<RigidBody*,RigidBody*>>& outPairs) override;
+        void query(const Vector2& minAABB, const Vector2& maxAABB, std::vector<RigidBody*>& out) override;
+        void rayCast(const Vector2& origin, const Vector2& direction, real maxT, const Vector2& extent,
+                     BroadPhaseCastCallback& callback) override;
+        // traces the rays in packets of four through the binary nodes, one SIMD slab test per node
+        void rayCastBatch(const CastRay* rays, CastHit* hits, int count) override;
+        // best-first over both trees, nodes are opened in order of their box distance to the point
+        void queryNearest(const Vector2& point, real maxDistance, BroadPhaseCastCallback& callback) override;
+
+        const std::vector<BVHNode>& getNodes() const { return tree.nodes; }
+        const std::vector<QBVHNode>& getWideNodes() const { return tree.wideNodes; }
+        const std::vector<BVHNode>& getStaticNodes() const { return staticTree.nodes; }
+        bool empty() const { return tree.empty() && staticTree.empty(); }
+
+        // quality metrics, lower is better for both
+        // SAH cost of the dynamic tree: sum of node perimeters relative to the root
+        real computeSAHCost() const;
+        // box overlap tests done by the last findPairs
+        int getOverlapTests() const { return overlapTests; }
+
+        void draw() override;
 
     private:
-        BVHNode* buildRecursive(std::vector<RigidBody*>& bodies, int start, int end);
-        void destroyRecursive(BVHNode* node);
-        void queryPairs(BVHNode* node, std::vector<std::pair<RigidBody*,RigidBody*>>& outPairs);
-        void queryNodeAgainstTree(BVHNode* nodeA, BVHNode* nodeB, 
-                                 std::vector<std::pair<RigidBody*,RigidBody*>>& outPairs);
-
-        bool AABBOverlap(const Vector2 &minA, const Vector2 &maxA,
-                         const Vector2 &minB, const Vector2 &maxB);
+        BVHHierarchy tree;
+        BVHHierarchy staticTree;
+
+        // static bodies in input order, compared every build to spot additions and removals
+        std::vector<RigidBody*> staticBodies;
+        std::vector<RigidBody*> dynamicBodies;
+
+        // the list the trees were last built from, leaves hold body pointers by slot
+        std::vector<RigidBody*> trackedBodies;
+        bool staticDirty = true;
+
+        int overlapTests = 0;
+
+        std::vector<int32_t> queryStack;
+
+        // node (or wide child) and the t where the cast enters it, nearest on top
+        std::vector<std::pair<int32_t, real>> castStack;
+
+        // open nodes of queryNearest, a min-heap on squared box distance
+        struct NearestEntry
+        {
+            real distanceSq;
+            const BVHHierarchy* h;
+            int32_t node;
+
+            bool operator>(const NearestEntry& o) const { return distanceSq > o.distanceSq; }
+        };
+
+        std::vector<NearestEntry> nearestHeap;
+
+        // per task output, concatenated in task order
+        std::vector<std::vector<std::pair<RigidBody*,RigidBody*>>> taskPairs;
+        std::vector<int> taskTests;
+
+        // one slot of a wide node, child is a QBVHNode::child value
+        struct WideSlot
+        {
+            int32_t child;
+            Vector2 minAABB;
+            Vector2 maxAABB;
+            uint32_t category;
+            uint32_t mask;
+        };
+
+        // one unit of wide pair traversal, b.child == selfTask means
+        // every pair inside wide node a
+        static constexpr int32_t selfTask = INT32_MAX;
+
+        struct WidePairTask
+        {
+            const BVHHierarchy* ha;
+            WideSlot a;
+            const BVHHierarchy* hb;
+            WideSlot b;
+        };
+
+        std::vector<WidePairTask> wideTasks;
+        std::vector<WidePairTask> wideScratch;
+
+        // LBVH scratch, codes[i] belongs to leafBodies[i] once sorted
+        std::vector<uint32_t> mortonCodes;
+        std::vector<uint32_t> mortonScratch;
+        std::vector<RigidBody*> bodyScratch;
+
+        struct LBVHTask
+        {
+            int32_t node;
+            int start;
+            int end;
+        };
+
+        std::vector<LBVHTask> lbvhTasks;
+        std::vector<LBVHTask> lbvhScratch;
+        std::vector<int32_t> lbvhTopNodes;
+
+        void buildHierarchy(BVHHierarchy& h, const std::vector<RigidBody*>& bodies);
+        int32_t buildRecursive(BVHHierarchy& h, int start, int end);
+        int splitMedian(BVHHierarchy& h, int start, int end, const Vector2& mn, const Vector2& mx);
+        int splitBinnedSAH(BVHHierarchy& h, int start, int end, const Vector2& mn, const Vector2& mx);
+        void buildLBVH(BVHHierarchy& h);
+        void sortMortonCodes(BVHHierarchy& h);
+        void emitLBVH(BVHHierarchy& h, int32_t index, int start, int end) const;
+        int findLBVHSplit(int start, int end) const;
+        void collapseWide(BVHHierarchy& h);
+        int32_t collapseNode(BVHHierarchy& h, int32_t binaryNode);
+        void refitWide(BVHHierarchy& h);
+        void findPairsWide(std::vector<std::pair<RigidBody*,RigidBody*>>& outPairs);
+        void splitWideTasks();
+        static void selfPairsWide(const BVHHierarchy& h, int32_t node,
+                                  std::vector<std::pair<RigidBody*,RigidBody*>>& outPairs, int& tests);
+        static void crossPairsWide(const BVHHierarchy& ha, const WideSlot& a, const BVHHierarchy& hb, const WideSlot& b,
+                                   std::vector<std::pair<RigidBody*,RigidBody*>>& outPairs, int& tests);
+        static WideSlot slotOf(const QBVHNode& w, int s);
+        void queryHierarchyWide(const BVHHierarchy& h, const Vector2& minAABB, const Vector2& maxAABB,
+                                std::vector<RigidBody*>& out);
+
+        // binary pair traversal, findPairs only takes it with wideNodes off
+        static void queryPairs(const BVHHierarchy& h, int32_t node,
+                               std::vector<std::pair<RigidBody*,RigidBody*>>& outPairs, int& tests);
+        static void queryNodeAgainstTree(const BVHHierarchy& ha, int32_t nodeA, const BVHHierarchy& hb, int32_t nodeB,
+                                         std::vector<std::pair<RigidBody*,RigidBody*>>& outPairs, int& tests);
+        void queryHierarchy(const BVHHierarchy& h, const Vector2& minAABB, const Vector2& maxAABB, std::vector<RigidBody*>& out);
+        real castHierarchy(const BVHHierarchy& h, const Vector2& origin, const Vector2& invDirection, real maxT,
+                           const Vector2& extent, BroadPhaseCastCallback& callback);
+        struct RayPacket;
+        void castPacket(const BVHHierarchy& h, RayPacket& packet, const CastRay* rays, CastHit* hits);
+        real castHierarchyWide(const BVHHierarchy& h, const Vector2& origin, const Vector2& invDirection, real maxT,
+                               const Vector2& extent, BroadPhaseCastCallback& callback);
+
+        static bool AABBOverlap(const Vector2 &minA, const Vector2 &maxA,
+                                const Vector2 &minB, const Vector2 &maxB);
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <AccelEngine/body.h>
+#include <AccelEngine/collision_cast.h>
+#include <algorithm>
+#include <vector>
+#include <utility>
+
+namespace AccelEngine
+{
+    // Receives the bodies a ray or shape cast may hit
+    class BroadPhaseCastCallback
+    {
+    public:
+        virtual ~BroadPhaseCastCallback() {}
+
+        // returns the new maxT: a hit's t keeps only closer bodies coming, maxT keeps everything, 0 stops the cast
+        virtual real reportBody(RigidBody *body, real maxT) = 0;
+    };
+
+    // filter bits a leaf passes up to its ancestors in a tree broadphase. a positive group
+    // overrides category and mask, so those leaves claim everything to keep culling safe
+    inline void LeafFilter(const RigidBody *b, uint32_t &category, uint32_t &mask)
+    {
+        if (!b->enableCollision)
+        {
+            category = 0;
+            mask = 0;
+        }
+        else if (b->groupIndex > 0)
+        {
+            category = ~0u;
+            mask = ~0u;
+        }
+        else
+        {
+            category = b->categoryBits;
+            mask = b->maskBits;
+        }
+    }
+
+    // two subtrees can only hold a colliding pair if each side's categories hit the other's mask
+    inline bool CanPair(uint32_t categoryA, uint32_t maskA, uint32_t categoryB, uint32_t maskB)
+    {
+        return (categoryA & maskB) != 0 && (categoryB & maskA) != 0;
+    }
+
+    // slab test of the ray origin + t / invDirection against a box, for t in [0, maxT]
+    inline bool RayOverlapsAABB(const Vector2 &origin, const Vector2 &invDirection, real maxT,
+                                const Vector2 &minAABB, const Vector2 &maxAABB, real &tEnter)
+    {
+        real tx1 = (minAABB.x - origin.x) * invDirection.x;
+        real tx2 = (maxAABB.x - origin.x) * invDirection.x;
+        real ty1 = (minAABB.y - origin.y) * invDirection.y;
+        real ty2 = (maxAABB.y - origin.y) * invDirection.y;
+
+        real tMin = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), (real)0.0f);
+        real tMax = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), maxT);
+
+        tEnter = tMin;
+        return tMin <= tMax;
+    }
+
+    // squared distance from a point to a box, 0 inside
+    inline real SquaredDistanceToAABB(const Vector2 &point, const Vector2 &minAABB, const Vector2 &maxAABB)
+    {
+        real dx = std::max(std::max(minAABB.x - point.x, point.x - maxAABB.x), (real)0.0f);
+        real dy = std::max(std::max(minAABB.y - point.y, point.y - maxAABB.y), (real)0.0f);
+        return dx * dx + dy * dy;
+    }
+
+    // 1 / direction with zero components mapped to a huge value instead of inf, so 0 * inf never shows up
+    inline Vector2 InverseDirection(const Vector2 &direction)
+    {
+        return Vector2(direction.x != 0.0f ? 1.0f / direction.x : (direction.x < 0.0f ? -1e30f : 1e30f),
+                       direction.y != 0.0f ? 1.0f / direction.y : (direction.y < 0.0f ? -1e30f : 1e30f));
+    }
+
+    // Common interface for everything World can use to find potential pairs.
+    class BroadPhase
+    {
+    public:
+        virtual ~BroadPhase() {}
+
+        // called once at the start of World::step, before any body moves
+        virtual void beginStep(const std::vector<RigidBody *> &) {}
+
+        // called every substep after integration, brings the structure up to date
+        virtual void update(const std::vector<RigidBody *> &bodies) = 0;
+
+        // every pair of colliding bodies whose AABBs overlap, each pair once.
+        // pairs where both bodies are static are left out
+        virtual void findPairs(std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs) = 0;
+
+        // appends every colliding body whose AABB overlaps [minAABB, maxAABB]
+        virtual void query(const Vector2 &minAABB, const Vector2 &maxAABB, std::vector<RigidBody *> &out) = 0;
+
+        // reports every colliding body whose AABB, grown by extent on each side, the ray
+        // origin + direction * t reaches before maxT. the default goes through query()
+        virtual void rayCast(const Vector2 &origin, const Vector2 &direction, real maxT, const Vector2 &extent,
+                             BroadPhaseCastCallback &callback);
+
+        // nearest hit for each ray, hits[i].body is null and hits[i].t is maxT on a miss.
+        // the default casts the rays one by one
+        virtual void rayCastBatch(const CastRay *rays, CastHit *hits, int count);
+
+        // reports colliding bodies whose AABB lies within maxDistance of point, callback.reportBody gets
+        // and returns the search radius so it can shrink as closer bodies come in, a negative radius stops.
+        // the default goes through query()
+        virtual void queryNearest(const Vector2 &point, real maxDistance, BroadPhaseCastCallback &callback);
+
+        virtual void clear() = 0;
+
+        virtual void draw() {}
+
+    protected:
+        // scratch for the default rayCast
+        std::vector<RigidBody *> castCandidates;
+    };
+}
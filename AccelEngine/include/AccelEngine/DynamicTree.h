@@ -0,0 +1,109 @@
+#pragma once
+#include <AccelEngine/body.h>
+#include <AccelEngine/BroadPhase.h>
+#include <unordered_map>
+#include <vector>
+
+namespace AccelEngine
+{
+    struct DynamicTreeNode
+    {
+        // fattened bounds for leaves, union of children for internal nodes
+        Vector2 minAABB;
+        Vector2 maxAABB;
+
+        RigidBody *body;
+
+        // OR of every leaf's filter bits below this node, see LeafFilter in BroadPhase.h
+        uint32_t categoryBits;
+        uint32_t maskBits;
+
+        int parent; // next free node while the node is on the free list
+        int left;
+        int right;
+
+        // leaf = 0, free node = -1
+        int height;
+
+        // leaves only, set while the leaf sits in the static tree
+        bool staticProxy;
+
+        bool isLeaf() const { return left == -1; }
+    };
+
+    // Persistent AABB tree. Leaves store a fattened copy of the body bounds so a
+    // body only touches the tree once it leaves its fat box. Static bodies (see
+    // RigidBody::isStatic) live in a second tree over the same node pool, so pair
+    // finding never walks static-vs-static overlaps.
+    class DynamicTree : public BroadPhase
+    {
+    public:
+        static constexpr int nullNode = -1;
+
+        // how far each leaf box is grown past the body bounds
+        real aabbMargin = 5.0f;
+
+        DynamicTree();
+
+        int createProxy(RigidBody *body);
+        void destroyProxy(int proxyId);
+
+        // returns true when the proxy had to be re-inserted
+        bool moveProxy(int proxyId);
+
+        // keeps the proxies in sync with the body list and moves the ones that left their fat box
+        void update(const std::vector<RigidBody *> &bodies) override;
+        void clear() override;
+
+        void findPairs(std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs) override;
+        void query(const Vector2 &minAABB, const Vector2 &maxAABB, std::vector<RigidBody *> &out) override;
+        void rayCast(const Vector2 &origin, const Vector2 &direction, real maxT, const Vector2 &extent,
+                     BroadPhaseCastCallback &callback) override;
+
+        int getHeight() const;
+        int getProxyCount() const { return (int)proxies.size(); }
+        int getMovedCount() const { return movedCount; }
+
+    private:
+        std::vector<DynamicTreeNode> nodes;
+        int root;
+        int staticRoot;
+        int freeList;
+
+        // proxies[i] belongs to trackedBodies[i]
+        std::vector<RigidBody *> trackedBodies;
+        std::vector<int> proxies;
+
+        // scratch for syncProxies
+        std::unordered_map<RigidBody *, int> proxyOf;
+        std::vector<int> scratchProxies;
+        int movedCount;
+
+        std::vector<int> queryStack;
+        std::vector<std::pair<int, real>> castStack;
+
+        int allocateNode();
+        void freeNode(int nodeId);
+
+        int &rootOf(int leaf) { return nodes[leaf].staticProxy ? staticRoot : root; }
+        void insertLeaf(int leaf);
+        void removeLeaf(int leaf);
+        int balance(int &treeRoot, int index);
+
+        // creates and destroys proxies for the bodies that came and went since the last update
+        void syncProxies(const std::vector<RigidBody *> &bodies);
+
+        void fattenAABB(int leaf);
+        // re-reads the leaf's filter bits from its body, returns true when they changed
+        bool refreshLeafFilter(int leaf);
+        void refreshAncestorFilters(int leaf);
+
+        void queryPairs(int node, std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs);
+        void queryNodeAgainstTree(int nodeA, int nodeB,
+                                  std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs);
+
+        static bool AABBOverlap(const Vector2 &minA, const Vector2 &maxA,
+                                const Vector2 &minB, const Vector2 &maxB);
+        static real perimeter(const Vector2 &mn, const Vector2 &mx);
+    };
+}
@@ -33,10 +33,31 @@ namespace AccelEngine
             return springs;
         }
 
+        // Remove every generator registered for the body, and every spring
+        // attached to it from the other end so none is left pointing at it
+        void remove(RigidBody *body)
+        {
+            auto attached = [body](const Registration &r)
+            {
+                if (r.body == body)
+                    return true;
+                Spring *s = dynamic_cast<Spring *>(r.fg);
+                return s && s->other == body;
+            };
+
+            for (const Registration &r : registrations)
+            {
+                if (attached(r))
+                    std::erase(springs, r.fg);
+            }
+            std::erase_if(registrations, attached);
+        }
+
         // Remove all generators (optional)
         void clear()
         {
             registrations.clear();
+            springs.clear();
         }
 
         void updateForces(real dt)
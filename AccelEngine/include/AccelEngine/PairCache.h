@@ -0,0 +1,101 @@
+#pragma once
+#include <AccelEngine/body.h>
+#include <AccelEngine/collision_narrow.h>
+#include <cstdint>
+#include <vector>
+
+namespace AccelEngine
+{
+    // Per pair state that lives as long as the broadphase keeps reporting the pair
+    struct CachedPair
+    {
+        RigidBody *a = nullptr; // lower bodyID
+        RigidBody *b = nullptr;
+
+        uint32_t lastSeen = 0;    // stamp of the last broadphase pass that reported the pair
+        bool touching = false;    // had a contact at the end of the last substep
+        bool touchingNow = false; // set while the current substep's contacts are processed
+
+        SATCache sat; // box pairs only, relative to a and b
+
+        // contact solver impulses of the last substep, relative to a and b, matched to
+        // the next contacts by feature key, or by position where the key changed
+        int impulseCount = 0;
+        uint32_t featureKeys[2] = {};
+        Vector2 impulsePoints[2];
+        real normalImpulses[2] = {};
+        real tangentImpulses[2] = {};
+    };
+
+    // Open addressing hash table with linear probing, keyed by both body IDs.
+    // Pairs still overlapping are only looked up, never re-inserted, and whatever
+    // was not reported by the latest pass is dropped by removeStale. Dropped pairs
+    // are only erased at the next beginUpdate, so entries stay put for the rest of
+    // the pass and a CachedPair reference stays valid as long as getGeneration()
+    // does not change.
+    class PairCache
+    {
+    public:
+        static uint64_t makeKey(const RigidBody *a, const RigidBody *b);
+
+        // starts a new broadphase pass, erasing the pairs the last removeStale dropped
+        void beginUpdate();
+
+        // reports one broadphase pair, isNew tells whether it had to be inserted
+        CachedPair &addPair(RigidBody *a, RigidBody *b, bool &isNew);
+
+        CachedPair *find(const RigidBody *a, const RigidBody *b);
+
+        // drops every pair that was not reported since beginUpdate, appending them to removed.
+        // they are skipped by forEachPair and getPairCount from here on
+        void removeStale(std::vector<CachedPair> &removed);
+
+        // drops every pair the body is part of, for bodies leaving the world
+        void removeBody(const RigidBody *body, std::vector<CachedPair> &removed);
+
+        void clear();
+
+        int getPairCount() const { return (int)(count - staleKeys.size()); }
+
+        // bumped whenever entries move
+        uint32_t getGeneration() const { return generation; }
+        int getAddedCount() const { return addedCount; }
+        int getRemovedCount() const { return removedCount; }
+
+        template <typename F>
+        void forEachPair(F &&fn)
+        {
+            for (Slot &s : slots)
+            {
+                if (s.key != emptyKey && s.pair.lastSeen == stamp)
+                    fn(s.pair);
+            }
+        }
+
+    private:
+        // body IDs start at 1, so a real key is never 0
+        static constexpr uint64_t emptyKey = 0;
+
+        struct Slot
+        {
+            uint64_t key;
+            CachedPair pair;
+        };
+
+        std::vector<Slot> slots;
+        uint32_t count = 0;
+        uint32_t mask = 0;
+        uint32_t stamp = 0;
+        uint32_t generation = 0;
+
+        int addedCount = 0;
+        int removedCount = 0;
+
+        // dropped by removeStale, still in the table until the next beginUpdate
+        std::vector<uint64_t> staleKeys;
+
+        uint32_t home(uint64_t key) const;
+        void grow();
+        void erase(uint64_t key);
+    };
+}
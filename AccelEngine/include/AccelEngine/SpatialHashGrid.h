@@ -0,0 +1,58 @@
+#pragma once
+#include <AccelEngine/body.h>
+#include <AccelEngine/BroadPhase.h>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+namespace AccelEngine
+{
+    // Uniform grid hashed into a fixed table. Bodies are binned with a counting
+    // sort into one flat entry array, so there is no per-cell storage. Works best
+    // when bodies are about the size of a cell.
+    class SpatialHashGrid : public BroadPhase
+    {
+    public:
+        real cellSize = 64.0f;
+
+        // re-bins every body into the grid
+        void update(const std::vector<RigidBody *> &bodies) override;
+        void clear() override;
+
+        void findPairs(std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs) override;
+        void query(const Vector2 &minAABB, const Vector2 &maxAABB, std::vector<RigidBody *> &out) override;
+
+        int getEntryCount() const { return (int)entries.size(); }
+
+    private:
+        struct Entry
+        {
+            int32_t cellX;
+            int32_t cellY;
+            uint32_t body;
+        };
+
+        std::vector<RigidBody *> trackedBodies;
+
+        // bodies covering more than maxBodyCells cells stay out of the grid and are tested
+        // against everything instead, so one huge box cannot flood the entry array
+        static constexpr int64_t maxBodyCells = 1024;
+        std::vector<uint32_t> largeBodies;
+        std::vector<uint8_t> isLarge;
+
+        // range of cells holding at least one entry, queries never look outside it
+        int32_t minCellX = 0, minCellY = 0, maxCellX = -1, maxCellY = -1;
+
+        // entries for bucket b are entries[bucketStart[b] .. bucketStart[b + 1])
+        std::vector<uint32_t> bucketStart;
+        std::vector<Entry> entries;
+        std::vector<Entry> unsorted;
+        uint32_t bucketMask = 0;
+
+        // saturates to +-cellLimit, so huge, infinite or NaN coordinates still give a finite range
+        static constexpr int32_t cellLimit = 1 << 30;
+        int32_t cellCoord(real v) const;
+        uint32_t hashCell(int32_t cx, int32_t cy) const;
+        bool reportQuery(const Entry &e, const Vector2 &minAABB, const Vector2 &maxAABB) const;
+    };
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <AccelEngine/body.h>
+#include <AccelEngine/BroadPhase.h>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+namespace AccelEngine
+{
+    // Sort-and-sweep broadphase on one axis. The endpoint array is kept between
+    // updates and re-sorted with insertion sort, which is close to linear when
+    // bodies only move a little per step.
+    class SweepAndPrune : public BroadPhase
+    {
+    public:
+        // 0 = x, 1 = y
+        int axis = 0;
+
+        // keeps the endpoints in sync with the body list and re-sorts them
+        void update(const std::vector<RigidBody *> &bodies) override;
+        void clear() override;
+
+        void findPairs(std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs) override;
+        void query(const Vector2 &minAABB, const Vector2 &maxAABB, std::vector<RigidBody *> &out) override;
+
+        // endpoint swaps done by the last update, a measure of how much the order changed
+        int getSwapCount() const { return swapCount; }
+
+    private:
+        struct Endpoint
+        {
+            real value;
+            uint32_t data; // body index << 1 | 1 for max endpoints
+
+            uint32_t body() const { return data >> 1; }
+            bool isMax() const { return data & 1; }
+        };
+
+        std::vector<RigidBody *> trackedBodies;
+        std::vector<Endpoint> endpoints;
+        int sortedAxis = 0;
+        int swapCount = 0;
+
+        // scratch for the sweep, active[activeSlot[i]] == i while body i is open
+        std::vector<uint32_t> active;
+        std::vector<uint32_t> activeSlot;
+
+        void rebuild(const std::vector<RigidBody *> &bodies);
+        void insertionSort();
+
+        static bool lessThan(const Endpoint &a, const Endpoint &b);
+    };
+}
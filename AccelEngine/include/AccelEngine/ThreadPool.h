@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace AccelEngine
+{
+    // Fixed set of worker threads that sleep between jobs. The calling thread
+    // joins in on every job, so a pool of 1 runs everything inline.
+    class ThreadPool
+    {
+    public:
+        // 0 uses one thread per hardware core
+        explicit ThreadPool(int threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // runs fn(index) for every index in [0, count) and returns when all are done.
+        // indices are handed out in order but may finish in any order
+        void parallelFor(int count, const std::function<void(int)> &fn);
+
+        // workers plus the calling thread
+        int getThreadCount() const { return (int)workers.size() + 1; }
+
+    private:
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        const std::function<void(int)> *job = nullptr;
+        int jobCount = 0;
+        std::atomic<int> nextIndex{0};
+        uint64_t generation = 0;
+        int busyWorkers = 0;
+        bool stopping = false;
+
+        void workerLoop();
+        void runIndices();
+    };
+}
@@ -16,6 +16,9 @@ namespace AccelEngine
         AABB
     };
 
+    // number of ShapeType values, sizes the narrowphase dispatch table
+    constexpr int shapeTypeCount = 2;
+
     struct Circle
     {
         real radius;
@@ -64,7 +67,18 @@ namespace AccelEngine
         Vector2 worldAABBMin;
         Vector2 worldAABBMax;
 
+        // box corners in world space and the outward unit normal of edge i -> i + 1,
+        // refreshed by updateAABB so the narrowphase never recomputes them per pair
+        Vector2 worldVertices[4];
+        Vector2 worldNormals[4];
+
         bool enableCollision;
+
+        // two bodies collide when each one's category is in the other's mask.
+        // a shared non-zero group overrides that: positive always, negative never
+        uint32_t categoryBits = 0x0001;
+        uint32_t maskBits = 0xFFFFFFFF;
+        int32_t groupIndex = 0;
         real boundingRadius = 0.0f;
         // mimic kinermatic body
         bool lockPosition = false;
@@ -72,6 +86,7 @@ namespace AccelEngine
         bool ignoreGravity = false;
 
         uint32_t entityID = 0; // used by engine
+        uint32_t bodyID = 0;   // set by World::addBody, unique per world, keys the pair cache
         void* userData = nullptr;
 
 
@@ -154,37 +169,26 @@ namespace AccelEngine
             torqueAccum = 0;
         }
 
-        void integrate(real duration)
+        // applies the accumulated forces and damping to the velocities
+        void integrateVelocity(real duration)
         {
-
-
             if (lockPosition)
             {
                 // no linear motion
                 velocity = Vector2(0, 0);
                 forceAccum.clear();
-                position = position;
 
                 if (!lockRotation)
                 {
                     real angularAcceleration = torqueAccum * inverseInertia;
                     rotation += angularAcceleration * duration;
                     rotation *= std::pow(angularDamping, duration);
-                    orientation += rotation * duration;
-
-                    // wrap to [0, 2*pi]
-                    while (orientation >= 6.28318531f)
-                        orientation -= 6.28318531f;
-                    while (orientation < 0)
-                        orientation += 6.28318531f;
                 }
                 else
                 {
                     rotation = 0;
                     torqueAccum = 0;
                 }
-
-                calculateDerivativeData();
                 return;
             }
 
@@ -209,6 +213,30 @@ namespace AccelEngine
 
             if (!lockRotation)
                 rotation *= std::pow(angularDamping, duration);
+        }
+
+        // moves the body along its velocities
+        void integratePosition(real duration)
+        {
+            if (lockPosition)
+            {
+                if (!lockRotation)
+                {
+                    orientation += rotation * duration;
+
+                    // wrap to [0, 2*pi]
+                    while (orientation >= 6.28318531f)
+                        orientation -= 6.28318531f;
+                    while (orientation < 0)
+                        orientation += 6.28318531f;
+                }
+
+                calculateDerivativeData();
+                return;
+            }
+
+            if (inverseMass <= 0.0f)
+                return;
 
             position += velocity * duration;
 
@@ -218,6 +246,12 @@ namespace AccelEngine
             calculateDerivativeData();
         }
 
+        void integrate(real duration)
+        {
+            integrateVelocity(duration);
+            integratePosition(duration);
+        }
+
         void updateAABB()
         {
             if (shapeType == ShapeType::CIRCLE)
@@ -229,18 +263,22 @@ namespace AccelEngine
             }
 
             // AABB for rotated box
-            Vector2 corners[4] = {
-                {-aabb.halfSize.x, -aabb.halfSize.y},
-                {aabb.halfSize.x, -aabb.halfSize.y},
-                {aabb.halfSize.x, aabb.halfSize.y},
-                {-aabb.halfSize.x, aabb.halfSize.y}};
+            getTransformedVertices(this, worldVertices);
+
+            // edge normals are the rotation's columns, no need to normalize
+            Vector2 axisX(transformMatrix.data[0], transformMatrix.data[2]);
+            Vector2 axisY(transformMatrix.data[1], transformMatrix.data[3]);
+            worldNormals[0] = axisY * -1.0f;
+            worldNormals[1] = axisX;
+            worldNormals[2] = axisY;
+            worldNormals[3] = axisX * -1.0f;
 
             worldAABBMin = {+1e9f, +1e9f};
             worldAABBMax = {-1e9f, -1e9f};
 
             for (int i = 0; i < 4; i++)
             {
-                Vector2 p = transformMatrix * corners[i] + position;
+                const Vector2 &p = worldVertices[i];
 
                 worldAABBMin.x = std::min(worldAABBMin.x, p.x);
                 worldAABBMin.y = std::min(worldAABBMin.y, p.y);
@@ -305,6 +343,18 @@ namespace AccelEngine
 
         inline real getBoundingRadius() const { return boundingRadius; }
 
+        // never moves during a step, broadphases can skip static vs static pairs
+        bool isStatic() const { return inverseMass <= 0.0f && !lockPosition; }
+
+        bool shouldCollide(const RigidBody &other) const
+        {
+            if (!enableCollision || !other.enableCollision)
+                return false;
+            if (groupIndex != 0 && groupIndex == other.groupIndex)
+                return groupIndex > 0;
+            return (categoryBits & other.maskBits) != 0 && (other.categoryBits & maskBits) != 0;
+        }
+
         static void getTransformedVertices(const RigidBody *body, Vector2 outVertices[4])
         {
             if (body->shapeType != ShapeType::AABB)
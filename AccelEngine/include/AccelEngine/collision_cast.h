@@ -0,0 +1,45 @@
+#pragma once
+#include <AccelEngine/body.h>
+
+namespace AccelEngine
+{
+    // first point where a ray or a swept shape touches a body
+    struct CastHit
+    {
+        RigidBody *body;
+        Vector2 point;  // on the surface of the hit body
+        Vector2 normal; // unit, points out of the hit body
+        real t;         // hit at origin + direction * t, 0 when the cast starts overlapping
+    };
+
+    // one ray of a batch, covers origin + direction * t for t in [0, maxT]
+    struct CastRay
+    {
+        Vector2 origin;
+        Vector2 direction;
+        real maxT;
+    };
+
+    // Exact tests for casts against a single body. A cast covers origin + direction * t
+    // for t in [0, maxT], direction does not need to be normalized.
+    class CastCollision
+    {
+    public:
+        static bool RayBody(const Vector2 &origin, const Vector2 &direction, real maxT, RigidBody *body, CastHit &hit);
+        static bool CircleCastBody(const Vector2 &origin, real radius, const Vector2 &direction, real maxT, RigidBody *body, CastHit &hit);
+        static bool BoxCastBody(const Vector2 &origin, const Vector2 &halfSize, real orientation, const Vector2 &direction, real maxT,
+                                RigidBody *body, CastHit &hit);
+
+        static bool RayCircle(const Vector2 &origin, const Vector2 &direction, real maxT, const Vector2 &center, real radius,
+                              real &t, Vector2 &normal);
+        // box with its corners rounded by radius, radius 0 is a plain oriented box
+        static bool RayRoundedBox(const Vector2 &origin, const Vector2 &direction, real maxT, const Vector2 &center,
+                                  const Matrix2 &rotation, const Vector2 &halfSize, real radius, real &t, Vector2 &normal);
+        // swept separating axis test between two oriented boxes, a moves along direction
+        static bool SweepBoxes(const Vector2 &centerA, const Matrix2 &rotationA, const Vector2 &halfA, const Vector2 &direction, real maxT,
+                               const Vector2 &centerB, const Matrix2 &rotationB, const Vector2 &halfB, real &t, Vector2 &normal, Vector2 &point);
+
+        // half size of the world AABB around a box with the given rotation
+        static Vector2 BoxExtent(const Matrix2 &rotation, const Vector2 &halfSize);
+    };
+}
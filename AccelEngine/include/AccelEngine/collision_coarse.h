@@ -1,6 +1,7 @@
 #pragma once
 
 #include <AccelEngine/body.h>
+#include <AccelEngine/BroadPhase.h>
 #include <vector>
 #include <utility>
 
@@ -12,4 +13,17 @@ namespace AccelEngine
     public:
         static void FindPotentialPairs(const std::vector<RigidBody *> &bodies, std::vector<std::pair<RigidBody *, RigidBody *>> &pairs);
     };
+
+    // O(n^2) all-pairs test behind the BroadPhase interface, mostly as a reference to compare against
+    class CoarseBroadPhase : public BroadPhase
+    {
+    public:
+        void update(const std::vector<RigidBody *> &bodies) override;
+        void findPairs(std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs) override;
+        void query(const Vector2 &minAABB, const Vector2 &maxAABB, std::vector<RigidBody *> &out) override;
+        void clear() override;
+
+    private:
+        std::vector<RigidBody *> trackedBodies;
+    };
 } // namespace AccelEngine
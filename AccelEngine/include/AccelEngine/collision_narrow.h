@@ -1,10 +1,49 @@
 #pragma once
 #include <AccelEngine/body.h>
+#include <cstdint>
 #include <vector>
 #include <utility>
 
 namespace AccelEngine
 {
+    // The features of A and B that produced a contact point. It stays the same while
+    // the same faces keep touching, so per point state can be matched between steps
+    struct ContactFeature
+    {
+        enum Type : uint8_t
+        {
+            VERTEX,
+            FACE
+        };
+
+        uint8_t indexA = 0;
+        uint8_t indexB = 0;
+        Type typeA = VERTEX;
+        Type typeB = VERTEX;
+
+        uint32_t key() const { return indexA | (indexB << 8) | ((uint32_t)typeA << 16) | ((uint32_t)typeB << 24); }
+    };
+
+    // Face that separated a box pair last time it was tested, kept per pair across
+    // steps so the next test can try it first. owner is relative to the A and B handed
+    // to IntersectRectangles, NONE while the pair touches or was never tested
+    struct SATCache
+    {
+        enum Owner : uint8_t
+        {
+            NONE,
+            A,
+            B
+        };
+
+        Owner owner = NONE;
+        uint8_t edge = 0;
+
+        SATCache flipped() const { return {owner == A ? B : owner == B ? A : NONE, edge}; }
+    };
+
+    class ThreadPool;
+
     struct Contact
     {
         RigidBody *a;
@@ -14,29 +53,102 @@ namespace AccelEngine
 
         Vector2 contactPoints[2];
         int contactCount;
+
+        // per point. only the box-box clipper sets features, circle contacts keep the defaults
+        ContactFeature features[2];
+        real pointPenetrations[2];
+
+        // index of the pair in the list handed to FindContacts, so callers can find
+        // their per-pair data without a lookup. not set by the single pair tests
+        uint32_t pair;
     };
     
 
+    // What one FindContacts call did with its pairs
+    struct NarrowPhaseStats
+    {
+        int pairs = 0;          // broadphase pairs handed in
+        int boundingCulled = 0; // rejected by the bounding circle test before any shape test
+        int shapeTests = 0;     // pairs that went on to SAT or the exact circle test
+        int contacts = 0;
+    };
+
+    // Collides two bodies of fixed shape types, the normal points from A to B
+    using CollideFunction = bool (*)(const RigidBody *A, const RigidBody *B, Contact &contact);
+
     class NarrowCollision
     {
     public:
+        // FindContacts on a thread pool hands out the pairs in tasks of at most this many
+        static constexpr uint32_t pairTaskSize = 1024;
+
+        // clipped box points up to this far in front of the reference face are kept, with a
+        // negative pointPenetration, so a slightly tilted box keeps both points on its support
+        static constexpr real speculativeDistance = 0.5f;
+
+        // dispatches on the shape pair through the collide table
         static bool SATCollision(const RigidBody *A, const RigidBody *B, Contact &contact);
 
-        static bool IntersectRectangles(const Vector2 * verticesA, Vector2 centera, const Vector2 * verticesB, Vector2 centerB, Contact &contacts);
+        // one entry per shape pair. swapped entries call the function with B and A and flip
+        // the normal, so only one function per unordered shape pair is needed
+        struct CollideEntry
+        {
+            CollideFunction function;
+            bool swapped;
+        };
+
+        static const CollideEntry &GetCollideEntry(ShapeType a, ShapeType b);
+
+        static bool CollideBoxes(const RigidBody *A, const RigidBody *B, Contact &contact);
+        static bool CollideCircles(const RigidBody *A, const RigidBody *B, Contact &contact);
+        static bool CollideCircleBox(const RigidBody *A, const RigidBody *B, Contact &contact);
+
         static bool IntersectCircles(Vector2 center1, real radius1, Vector2 center2, real radius2, Contact &contact);
         static bool IntersectCircleRectangle(Vector2 center1, real radius, Vector2 * vertices, Contact &contact);
 
+        // box tests take precomputed unit edge normals, see RigidBody::worldNormals.
+        // a cache, when given, is tested first and updated with the separating face
+        static bool IntersectRectangles(const Vector2 * verticesA, const Vector2 * normalsA,
+                                        const Vector2 * verticesB, const Vector2 * normalsB, Contact &contacts,
+                                        SATCache *cache = nullptr);
+        static bool IntersectCircleRectangle(Vector2 center1, real radius, const Vector2 * vertices, const Vector2 * normals, Contact &contact);
+
+        // outward unit normal of each edge i -> i + 1
+        static void ComputeEdgeNormals(const Vector2 * vertices, Vector2 * normals);
+
         static std::pair<real, real> projectOnAxis(const Vector2 * vertices, Vector2 axis);
         static std::pair<real, real> projectOnCircle(Vector2 center, real radius, const Vector2 * vertices, Vector2 axis);
         static int FindClosestPointOnRectangle(Vector2 center, const Vector2 * vertices);
         static void FindPointSegmentDistance(Vector2 center, Vector2 edge1, Vector2 edge2, real &distanceSquared, Vector2 &conatct);
 
+        // exact overlap tests used to confirm broadphase query candidates
+        static bool PointInBody(const Vector2 &point, const RigidBody *body);
+        static bool CircleOverlapsBody(const Vector2 &center, real radius, const RigidBody *body);
+        static bool AABBOverlapsBody(const Vector2 &minAABB, const Vector2 &maxAABB, const RigidBody *body);
+
+        // distance from the point to the body's surface, 0 when the point is inside
+        static real DistanceToBody(const Vector2 &point, const RigidBody *body);
+
+        // buckets the pairs by shape pair and runs every bucket through its collide function in one loop.
+        // contacts come out grouped by shape pair, in pair order inside each group.
+        // satCache, when given, holds the SATCache of potentialPairs[i] at [i], box pairs update theirs in place.
+        // with a thread pool every task fills its own buffer and the buffers are joined in task
+        // order, so the contacts come out the same for any thread count. stats, when given, is overwritten
         static void FindContacts(
             const std::vector<std::pair<RigidBody *, RigidBody *>> &potentialPairs,
-            std::vector<Contact> &contacts);
+            std::vector<Contact> &contacts,
+            SATCache *satCache = nullptr,
+            ThreadPool *threadPool = nullptr,
+            NarrowPhaseStats *stats = nullptr);
 
         // contacts
         static void FindCircleVsRectangleContact(Vector2 center, real radius, Vector2 rectCenter, const Vector2 * verticesA, Contact &contact);
-        static void FindRectVsRectContact(const Vector2 * verticesA, const Vector2 * verticesB, Contact &contacts);
+        // clips the incident box's most anti-parallel edge against the sides of the reference face.
+        // gives up to two points with feature IDs, see speculativeDistance; flip means the reference box is B
+        static void FindRectVsRectContact(const Vector2 * verticesRef, const Vector2 * normalsRef, int referenceEdge,
+                                          const Vector2 * verticesInc, const Vector2 * normalsInc, bool flip, Contact &contact);
+
+        // largest signed distance of the other box from any face of the first, and that face
+        static real FindMaxSeparation(const Vector2 * vertices1, const Vector2 * normals1, const Vector2 * vertices2, int &edge);
     };
 };
@@ -1,6 +1,8 @@
 #pragma once
 #include <AccelEngine/body.h>
 #include <AccelEngine/collision_narrow.h>
+#include <AccelEngine/PairCache.h>
+#include <vector>
 
 namespace AccelEngine
 {
@@ -16,4 +18,72 @@ namespace AccelEngine
         // Complete resolution (position + velocity)
         static void Solve(Contact& contact, float dt);
     };
+
+    // Sequential impulse contact solver. preSolve turns every contact into a constraint with
+    // its effective masses and applies the impulses the pair ended the last substep with,
+    // solve is then run iterations times, each pass clamping the accumulated impulse of every
+    // point instead of the per pass one. storeImpulses keeps the result for the next substep
+    class ContactSolver
+    {
+    public:
+        int iterations = 10;
+        bool warmStarting = true;
+
+        // share of the penetration beyond slop pushed out per substep through the velocity bias
+        real baumgarte = 0.2f;
+        real slop = 0.2f;
+        // cap on the push out speed, so deep overlaps (spawning into a pile) come apart without exploding
+        real maxPushSpeed = 300.0f;
+        // slower approaches do not bounce, so resting contacts can settle
+        real restitutionThreshold = 30.0f;
+        // how far a contact point may move between substeps and still pick up the old impulse
+        real matchDistance = 1.0f;
+
+        // contactPairs[i] is the pair cache entry of contacts[i], null for no warm starting
+        void preSolve(const std::vector<Contact> &contacts, CachedPair *const *contactPairs, real dt);
+        void solve();
+        void storeImpulses();
+
+    private:
+        struct PointConstraint
+        {
+            Vector2 ra;
+            Vector2 rb;
+            real normalMass;
+            real tangentMass;
+            real velocityBias;
+            real normalImpulse;
+            real tangentImpulse;
+            uint32_t featureKey; // relative to the pair's a and b
+        };
+
+        struct Constraint
+        {
+            RigidBody *a;
+            RigidBody *b;
+            // locked bodies take part with zero inverse mass or inertia
+            real inverseMassA, inverseInertiaA;
+            real inverseMassB, inverseInertiaB;
+
+            Vector2 normal;
+            Vector2 tangent;
+            real friction;
+
+            int pointCount;
+            PointConstraint points[2];
+
+            // normal mass matrix of a two point contact, see solveBlock
+            bool blockSolve;
+            real k11, k12, k22;
+
+            CachedPair *pair;
+            bool flipped; // a and b are the pair's b and a
+        };
+
+        std::vector<Constraint> constraints;
+
+        static void solveBlock(Constraint &c);
+        static void applyImpulse(Constraint &c, const PointConstraint &p, const Vector2 &impulse);
+        static Vector2 relativeVelocity(const Constraint &c, const PointConstraint &p);
+    };
 }
\ No newline at end of file
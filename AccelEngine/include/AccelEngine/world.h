@@ -4,9 +4,18 @@
 #include <AccelEngine/collision_coarse.h>
 #include <AccelEngine/collision_narrow.h>
 #include <AccelEngine/collision_resolve.h>
+#include <AccelEngine/collision_cast.h>
 #include <AccelEngine/joint.h>
 #include <AccelEngine/BVH.h>
+#include <AccelEngine/DynamicTree.h>
+#include <AccelEngine/SweepAndPrune.h>
+#include <AccelEngine/SpatialHashGrid.h>
 #include <AccelEngine/profiler.h>
+#include <AccelEngine/ThreadPool.h>
+#include <AccelEngine/PairCache.h>
+#include <memory>
+#include <algorithm>
+#include <span>
 
 namespace AccelEngine
 {
@@ -17,6 +26,85 @@ namespace AccelEngine
         RigidBody *b;
     };
 
+    enum class BroadPhaseType
+    {
+        DYNAMIC_TREE,   // persistent tree, only bodies leaving their fat box are re-inserted
+        BVH,            // broadPhase rebuilt every step and refit every substep
+        SWEEP_AND_PRUNE, // endpoints kept sorted across steps with insertion sort
+        SPATIAL_HASH,    // uniform grid, for lots of similar sized bodies
+        COARSE           // O(n^2) all-pairs test
+    };
+
+    // runs an exact cast test on each broadphase candidate and hands hits to the user callback
+    template <typename Test, typename Callback>
+    class CastAdapter : public BroadPhaseCastCallback
+    {
+    public:
+        CastAdapter(Test &test, Callback &callback) : test(test), callback(callback) {}
+
+        real reportBody(RigidBody *body, real maxT) override
+        {
+            CastHit hit;
+            if (!test(body, maxT, hit))
+                return maxT;
+            return callback(hit);
+        }
+
+    private:
+        Test &test;
+        Callback &callback;
+    };
+
+    struct NearestHit
+    {
+        RigidBody *body;
+        real distance; // to the body's surface, 0 when the point is inside
+    };
+
+    // keeps the k nearest bodies as a max-heap in the caller's array, the radius
+    // handed back to the broadphase shrinks to the k-th distance once it is full
+    class NearestCollector : public BroadPhaseCastCallback
+    {
+    public:
+        NearestCollector(const Vector2 &point, NearestHit *out, int k) : point(point), out(out), k(k) {}
+
+        real reportBody(RigidBody *body, real maxDistance) override
+        {
+            real d = NarrowCollision::DistanceToBody(point, body);
+            if (d > maxDistance)
+                return maxDistance;
+
+            auto further = [](const NearestHit &a, const NearestHit &b) { return a.distance < b.distance; };
+
+            if (count < k)
+            {
+                out[count++] = {body, d};
+                std::push_heap(out, out + count, further);
+            }
+            else if (d < out[0].distance)
+            {
+                std::pop_heap(out, out + count, further);
+                out[count - 1] = {body, d};
+                std::push_heap(out, out + count, further);
+            }
+
+            return count == k ? out[0].distance : maxDistance;
+        }
+
+        // sorts the heap nearest first and returns how many hits it holds
+        int finish()
+        {
+            std::sort_heap(out, out + count, [](const NearestHit &a, const NearestHit &b) { return a.distance < b.distance; });
+            return count;
+        }
+
+    private:
+        Vector2 point;
+        NearestHit *out;
+        int k;
+        int count = 0;
+    };
+
     class World
     {
     protected:
@@ -25,12 +113,158 @@ namespace AccelEngine
         std::vector<Contact> contacts;
         std::vector<Contact> contactsThisFrame;
 
+        // declared before broadPhase so it outlives anything holding a pointer to it
+        ThreadPool threadPool;
+
+        std::unique_ptr<BroadPhase> broadPhase;
+        BroadPhaseType broadPhaseType;
+
+        // broadphase pairs kept across substeps, drives the begin / end contact events
+        PairCache pairCache;
+        std::vector<CachedPair> removedPairs;
+        // end events from removeBody, handed out by the next step
+        std::vector<CollisionEvent> removedEndContactEvents;
+        // pairCache entry of potentialPairs[i], valid until the next updatePairCache
+        std::vector<CachedPair *> pairData;
+        // SAT cache of potentialPairs[i] in that pair's order, copied out of pairData so the
+        // narrowphase never touches the hash table. written back by updateContactEvents
+        std::vector<SATCache> pairSAT;
+        // narrowphase counters of the last substep
+        NarrowPhaseStats narrowStats;
+        // pairCache entry of contacts[i], warm starts the contact solver
+        std::vector<CachedPair *> contactPairs;
+        uint32_t nextBodyID = 1;
+
+        // bodies moved or were added since the broadphase last saw them
+        bool broadPhaseStale = true;
+
+        // broadphase candidates of the last overlap query
+        std::vector<RigidBody *> queryCandidates;
+
+        // runs the broadphase over the box and hands every candidate passing the exact test to callback,
+        // which returns false to stop the query
+        template <typename Test, typename Callback>
+        void queryShape(const Vector2 &minAABB, const Vector2 &maxAABB, Test &&test, Callback &callback)
+        {
+            syncBroadPhase();
+
+            queryCandidates.clear();
+            broadPhase->query(minAABB, maxAABB, queryCandidates);
+
+            for (RigidBody *body : queryCandidates)
+            {
+                if (test(body) && !callback(body))
+                    return;
+            }
+        }
+
+        // collects up to maxResults bodies into out and returns how many were written
+        template <typename Query>
+        static int collect(Query &&query, RigidBody **out, int maxResults)
+        {
+            int count = 0;
+            if (maxResults <= 0)
+                return 0;
+
+            query([&](RigidBody *body)
+            {
+                out[count++] = body;
+                return count < maxResults;
+            });
+            return count;
+        }
+
+        // queries run on the broadphase, bring it up to date first
+        void syncBroadPhase()
+        {
+            if (!broadPhaseStale)
+                return;
+            broadPhase->update(bodies);
+            broadPhaseStale = false;
+        }
+
+        void updatePairCache()
+        {
+            pairCache.beginUpdate();
+
+            pairData.resize(potentialPairs.size());
+            uint32_t generation = pairCache.getGeneration();
+
+            bool isNew;
+            for (size_t i = 0; i < potentialPairs.size(); i++)
+                pairData[i] = &pairCache.addPair(potentialPairs[i].first, potentialPairs[i].second, isNew);
+
+            // a rehash while adding moved the entries taken before it, which is rare enough to just look them up again
+            if (pairCache.getGeneration() != generation)
+            {
+                for (size_t i = 0; i < potentialPairs.size(); i++)
+                    pairData[i] = pairCache.find(potentialPairs[i].first, potentialPairs[i].second);
+            }
+
+            // the entries were just touched, the copy is cheap now
+            pairSAT.resize(potentialPairs.size());
+            for (size_t i = 0; i < potentialPairs.size(); i++)
+            {
+                const CachedPair *p = pairData[i];
+                pairSAT[i] = p->a == potentialPairs[i].first ? p->sat : p->sat.flipped();
+            }
+
+            // stale pairs stay in place until the next pass, pairData stays valid
+            removedPairs.clear();
+            pairCache.removeStale(removedPairs);
+
+            // separated far enough that the broadphase dropped them while still touching
+            for (const CachedPair &p : removedPairs)
+            {
+                if (p.touching)
+                    endContactEvents.push_back({p.a, p.b});
+            }
+        }
+
+        void updateContactEvents()
+        {
+            // every contact came from one of this substep's pairs, pairData already has its entry
+            contactPairs.resize(contacts.size());
+            for (size_t i = 0; i < contacts.size(); i++)
+            {
+                contactPairs[i] = pairData[contacts[i].pair];
+                contactPairs[i]->touchingNow = true;
+            }
+
+            // pairs the broadphase dropped were settled by removeStale, the rest are all in pairData
+            for (size_t i = 0; i < pairData.size(); i++)
+            {
+                CachedPair *p = pairData[i];
+                p->sat = p->a == potentialPairs[i].first ? pairSAT[i] : pairSAT[i].flipped();
+
+                // impulses from an earlier touch would be stale by the next one
+                if (!p->touchingNow)
+                    p->impulseCount = 0;
+
+                if (p->touchingNow && !p->touching)
+                    beginContactEvents.push_back({p->a, p->b});
+                else if (!p->touchingNow && p->touching)
+                    endContactEvents.push_back({p->a, p->b});
+
+                p->touching = p->touchingNow;
+                p->touchingNow = false;
+            }
+        }
+
     public:
         std::vector<Joint *> joints;
+        // iteration count, warm starting and position correction for the contacts
+        ContactSolver contactSolver;
         std::vector<CollisionEvent> collisionEvents;
-        BVHTree broadPhase;
 
-        World() {}
+        // pairs that started or stopped touching during the last step
+        std::vector<CollisionEvent> beginContactEvents;
+        std::vector<CollisionEvent> endContactEvents;
+
+        World(BroadPhaseType type = BroadPhaseType::DYNAMIC_TREE)
+        {
+            setBroadPhase(type);
+        }
 
         ~World()
         {
@@ -39,7 +273,30 @@ namespace AccelEngine
 
         void addBody(RigidBody *body)
         {
+            body->bodyID = nextBodyID++;
             bodies.push_back(body);
+            broadPhaseStale = true;
+        }
+
+        // takes the body and every joint attached to it out of the simulation,
+        // the caller keeps ownership of both
+        void removeBody(RigidBody *body)
+        {
+            auto it = std::find(bodies.begin(), bodies.end(), body);
+            if (it == bodies.end())
+                return;
+
+            bodies.erase(it);
+            std::erase_if(joints, [body](const Joint *j) { return j->A == body || j->B == body; });
+            removedPairs.clear();
+            pairCache.removeBody(body, removedPairs);
+            broadPhaseStale = true;
+
+            for (const CachedPair &p : removedPairs)
+            {
+                if (p.touching)
+                    removedEndContactEvents.push_back({p.a, p.b});
+            }
         }
 
         void addJoint(Joint *j)
@@ -47,6 +304,50 @@ namespace AccelEngine
             joints.push_back(j);
         }
 
+        // swaps the broadphase, the new one picks up the bodies on the next step
+        void setBroadPhase(BroadPhaseType type)
+        {
+            switch (type)
+            {
+            case BroadPhaseType::DYNAMIC_TREE:
+                broadPhase = std::make_unique<DynamicTree>();
+                break;
+            case BroadPhaseType::BVH:
+            {
+                auto bvh = std::make_unique<BVHTree>();
+                bvh->threadPool = &threadPool;
+                broadPhase = std::move(bvh);
+                break;
+            }
+            case BroadPhaseType::SWEEP_AND_PRUNE:
+                broadPhase = std::make_unique<SweepAndPrune>();
+                break;
+            case BroadPhaseType::SPATIAL_HASH:
+                broadPhase = std::make_unique<SpatialHashGrid>();
+                break;
+            case BroadPhaseType::COARSE:
+                broadPhase = std::make_unique<CoarseBroadPhase>();
+                break;
+            }
+            broadPhaseType = type;
+            broadPhaseStale = true;
+        }
+
+        BroadPhaseType getBroadPhaseType() const
+        {
+            return broadPhaseType;
+        }
+
+        BroadPhase &getBroadPhase()
+        {
+            return *broadPhase;
+        }
+
+        ThreadPool &getThreadPool()
+        {
+            return threadPool;
+        }
+
         std::vector<Joint *> &getJoints()
         {
             return joints;
@@ -57,9 +358,158 @@ namespace AccelEngine
             return collisionEvents;
         }
 
+        const std::vector<CollisionEvent> &GetBeginContactEvents() const
+        {
+            return beginContactEvents;
+        }
+
+        const std::vector<CollisionEvent> &GetEndContactEvents() const
+        {
+            return endContactEvents;
+        }
+
+        const PairCache &getPairCache() const
+        {
+            return pairCache;
+        }
+
+        const NarrowPhaseStats &getNarrowPhaseStats() const
+        {
+            return narrowStats;
+        }
+
+        // ray and shape casts along origin + direction * t, t in [0, maxT]. callback(const CastHit &)
+        // returns the new maxT: hit.t to look only for closer hits, maxT to get every hit, 0 to stop.
+        // nothing is allocated once the broadphase scratch buffers have grown
+        template <typename Callback>
+        void rayCast(const Vector2 &origin, const Vector2 &direction, real maxT, Callback &&callback)
+        {
+            syncBroadPhase();
+
+            auto test = [&](RigidBody *body, real t, CastHit &hit)
+            {
+                return CastCollision::RayBody(origin, direction, t, body, hit);
+            };
+            CastAdapter<decltype(test), Callback> adapter(test, callback);
+            broadPhase->rayCast(origin, direction, maxT, Vector2(0.0f, 0.0f), adapter);
+        }
+
+        template <typename Callback>
+        void circleCast(const Vector2 &origin, real radius, const Vector2 &direction, real maxT, Callback &&callback)
+        {
+            syncBroadPhase();
+
+            auto test = [&](RigidBody *body, real t, CastHit &hit)
+            {
+                return CastCollision::CircleCastBody(origin, radius, direction, t, body, hit);
+            };
+            CastAdapter<decltype(test), Callback> adapter(test, callback);
+            broadPhase->rayCast(origin, direction, maxT, Vector2(radius, radius), adapter);
+        }
+
+        template <typename Callback>
+        void boxCast(const Vector2 &origin, const Vector2 &halfSize, real orientation, const Vector2 &direction, real maxT,
+                     Callback &&callback)
+        {
+            syncBroadPhase();
+
+            Matrix2 rotation;
+            rotation.setOrientation(orientation);
+
+            auto test = [&](RigidBody *body, real t, CastHit &hit)
+            {
+                return CastCollision::BoxCastBody(origin, halfSize, orientation, direction, t, body, hit);
+            };
+            CastAdapter<decltype(test), Callback> adapter(test, callback);
+            broadPhase->rayCast(origin, direction, maxT, CastCollision::BoxExtent(rotation, halfSize), adapter);
+        }
+
+        // nearest hit for every ray, written to hits[i]. a miss leaves hits[i].body null.
+        // batches of coherent rays (sensor fans, lidar sweeps) are traced in packets where the broadphase supports it
+        void rayCastBatch(std::span<const CastRay> rays, std::span<CastHit> hits)
+        {
+            syncBroadPhase();
+            broadPhase->rayCastBatch(rays.data(), hits.data(), (int)std::min(rays.size(), hits.size()));
+        }
+
+        // nearest hit only, false when the ray reaches maxT without hitting anything
+        bool rayCastClosest(const Vector2 &origin, const Vector2 &direction, real maxT, CastHit &closest)
+        {
+            bool found = false;
+            rayCast(origin, direction, maxT, [&](const CastHit &hit)
+            {
+                closest = hit;
+                found = true;
+                return hit.t;
+            });
+            return found;
+        }
+
+        // overlap queries against the exact body shapes, bodies with collision disabled are never reported.
+        // callback(RigidBody *) returns false to stop early
+        template <typename Callback>
+        void queryAABB(const Vector2 &minAABB, const Vector2 &maxAABB, Callback &&callback)
+        {
+            queryShape(minAABB, maxAABB, [&](RigidBody *body)
+            {
+                return NarrowCollision::AABBOverlapsBody(minAABB, maxAABB, body);
+            }, callback);
+        }
+
+        template <typename Callback>
+        void queryPoint(const Vector2 &point, Callback &&callback)
+        {
+            queryShape(point, point, [&](RigidBody *body)
+            {
+                return NarrowCollision::PointInBody(point, body);
+            }, callback);
+        }
+
+        template <typename Callback>
+        void queryCircle(const Vector2 &center, real radius, Callback &&callback)
+        {
+            Vector2 extent(radius, radius);
+            queryShape(center - extent, center + extent, [&](RigidBody *body)
+            {
+                return NarrowCollision::CircleOverlapsBody(center, radius, body);
+            }, callback);
+        }
+
+        int queryAABB(const Vector2 &minAABB, const Vector2 &maxAABB, RigidBody **out, int maxResults)
+        {
+            return collect([&](auto &&cb) { queryAABB(minAABB, maxAABB, cb); }, out, maxResults);
+        }
+
+        int queryPoint(const Vector2 &point, RigidBody **out, int maxResults)
+        {
+            return collect([&](auto &&cb) { queryPoint(point, cb); }, out, maxResults);
+        }
+
+        int queryCircle(const Vector2 &center, real radius, RigidBody **out, int maxResults)
+        {
+            return collect([&](auto &&cb) { queryCircle(center, radius, cb); }, out, maxResults);
+        }
+
+        // the k bodies closest to point within radius, measured to their real shape, written to out nearest first.
+        // returns how many were found. bodies with collision disabled are never reported
+        int queryNearest(const Vector2 &point, int k, real radius, NearestHit *out)
+        {
+            if (k <= 0)
+                return 0;
+
+            syncBroadPhase();
+
+            NearestCollector collector(point, out, k);
+            broadPhase->queryNearest(point, radius, collector);
+            return collector.finish();
+        }
+
         void clear()
         {
             bodies.clear();
+            broadPhase->clear();
+            pairCache.clear();
+            broadPhaseStale = true;
         }
 
         const std::vector<Contact> getContacts() const
@@ -89,18 +539,29 @@ namespace AccelEngine
         {
             float subdt = dt / substeps;
 
-            broadPhase.build(bodies);
+            broadPhase->beginStep(bodies);
+
+            beginContactEvents.clear();
+            endContactEvents.swap(removedEndContactEvents);
+            removedEndContactEvents.clear();
+
             for (int i = 0; i < substeps; i++)
             {
+                // velocities first, positions only move once the contacts and joints have
+                // corrected them, so resting contacts do not sink by a substep of gravity
                 for (auto *b : bodies)
-                    b->integrate(subdt);
+                    b->integrateVelocity(subdt);
 
                 potentialPairs.clear();
                 contacts.clear();
 
                 PROFILE_SCOPE("Collision");
-                broadPhase.findPairs(potentialPairs);
-                NarrowCollision::FindContacts(potentialPairs, contacts);
+                broadPhase->update(bodies);
+                broadPhase->findPairs(potentialPairs);
+                updatePairCache();
+
+                NarrowCollision::FindContacts(potentialPairs, contacts, pairSAT.data(), &threadPool, &narrowStats);
+                updateContactEvents();
 
                 collisionEvents.clear();
 
@@ -112,10 +573,11 @@ namespace AccelEngine
                 for (auto *j : joints)
                     j->preSolve(subdt);
 
-                for (auto &c : contacts)
                 {
                     PROFILE_SCOPE("Solve");
-                    CollisionResolve::Solve(c, subdt);
+                    contactSolver.preSolve(contacts, contactPairs.data(), subdt);
+                    contactSolver.solve();
+                    contactSolver.storeImpulses();
                 }
 
                 for (int it = 0; it < 100; it++)
@@ -125,8 +587,14 @@ namespace AccelEngine
                         j->solve(subdt);
                     }
                 }
+
+                for (auto *b : bodies)
+                    b->integratePosition(subdt);
             }
             contactsThisFrame = contacts;
+
+            // the solver moved bodies after the last broadphase update
+            broadPhaseStale = true;
         }
     };
 }
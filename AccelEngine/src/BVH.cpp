@@ -1,11 +1,17 @@
 #include <AccelEngine/BVH.h>
 #include <algorithm>
+#include <bit>
 #include <cmath>
-#include <../../Sandbox/include/renderer2D.h> 
+#include <functional>
+#include <limits>
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+#include <../../Sandbox/include/renderer2D.h>
 
 using namespace AccelEngine;
 
-BVHTree::BVHTree() : root(nullptr) {}
+BVHTree::BVHTree() {}
 
 BVHTree::~BVHTree()
 {
@@ -20,47 +26,111 @@ bool BVHTree::AABBOverlap(const Vector2 &minA, const Vector2 &maxA,
     return true;
 }
 
-void BVHTree::destroy()
+static inline void setLeaf(BVHNode& node, const RigidBody* b)
 {
-    destroyRecursive(root);
-    root = nullptr;
+    node.minAABB = b->worldAABBMin;
+    node.maxAABB = b->worldAABBMax;
+    LeafFilter(b, node.categoryBits, node.maskBits);
 }
 
-void BVHTree::destroyRecursive(BVHNode* node)
+static inline void mergeChildren(BVHNode& node, const BVHNode& l, const BVHNode& r)
 {
-    if (!node) return;
-    destroyRecursive(node->left);
-    destroyRecursive(node->right);
-    delete node;
+    node.minAABB = Vector2(std::min(l.minAABB.x, r.minAABB.x), std::min(l.minAABB.y, r.minAABB.y));
+    node.maxAABB = Vector2(std::max(l.maxAABB.x, r.maxAABB.x), std::max(l.maxAABB.y, r.maxAABB.y));
+    node.categoryBits = l.categoryBits | r.categoryBits;
+    node.maskBits = l.maskBits | r.maskBits;
+}
+
+void BVHTree::destroy()
+{
+    tree.clear();
+    staticTree.clear();
+    staticBodies.clear();
+    dynamicBodies.clear();
+    staticDirty = true;
 }
 
 void BVHTree::build(const std::vector<RigidBody*>& bodies)
 {
-    destroy();
+    trackedBodies = bodies;
+    dynamicBodies.clear();
 
-    if (bodies.empty())
+    // count the statics in place first, most steps they match the cached list exactly
+    size_t staticCount = 0;
+    bool staticChanged = staticDirty;
+
+    for (RigidBody* b : bodies)
     {
-        root = nullptr;
-        return;
+        if (!b->isStatic())
+        {
+            dynamicBodies.push_back(b);
+            continue;
+        }
+
+        if (staticCount >= staticBodies.size() || staticBodies[staticCount] != b)
+            staticChanged = true;
+        staticCount++;
+    }
+
+    if (staticCount != staticBodies.size())
+        staticChanged = true;
+
+    if (staticChanged)
+    {
+        staticBodies.clear();
+        for (RigidBody* b : bodies)
+        {
+            if (b->isStatic())
+                staticBodies.push_back(b);
+        }
+
+        buildHierarchy(staticTree, staticBodies);
+        staticDirty = false;
     }
 
-    std::vector<RigidBody*> temp = bodies;
-    root = buildRecursive(temp, 0, temp.size());
+    // the static tree may have been built before wide nodes were switched on
+    if (wideNodes && !staticTree.empty() && staticTree.wideNodes.empty())
+        collapseWide(staticTree);
+
+    buildHierarchy(tree, dynamicBodies);
+}
+
+void BVHTree::buildHierarchy(BVHHierarchy& h, const std::vector<RigidBody*>& bodies)
+{
+    h.clear();
+
+    if (bodies.empty())
+        return;
+
+    // clear() keeps capacity, so once the scene stops growing this never allocates
+    h.leafBodies.assign(bodies.begin(), bodies.end());
+    h.nodes.reserve(2 * bodies.size() - 1);
+
+    if (buildMode == BVHBuildMode::LBVH)
+        buildLBVH(h);
+    else
+        buildRecursive(h, 0, (int)h.leafBodies.size());
+
+    if (wideNodes)
+        collapseWide(h);
 }
 
-BVHNode* BVHTree::buildRecursive(std::vector<RigidBody*>& bodies, int start, int end)
+int32_t BVHTree::buildRecursive(BVHHierarchy& h, int start, int end)
 {
     int count = end - start;
-    if (count <= 0) return nullptr;
 
-    BVHNode* node = new BVHNode();
+    int32_t index = (int32_t)h.nodes.size();
+    h.nodes.push_back({});
+    BVHNode& node = h.nodes[index];
+    node.left = nullNode;
+    node.right = nullNode;
+    node.body = -1;
 
     if (count == 1)
     {
-        node->body = bodies[start];
-        node->minAABB = bodies[start]->worldAABBMin;
-        node->maxAABB = bodies[start]->worldAABBMax;
-        return node;
+        node.body = start;
+        setLeaf(node, h.leafBodies[start]);
+        return index;
     }
 
     Vector2 mn(1e9f, 1e9f);
@@ -68,8 +138,8 @@ BVHNode* BVHTree::buildRecursive(std::vector<RigidBody*>& bodies, int start, int
 
     for (int i = start; i < end; i++)
     {
-        const Vector2& a = bodies[i]->worldAABBMin;
-        const Vector2& b = bodies[i]->worldAABBMax;
+        const Vector2& a = h.leafBodies[i]->worldAABBMin;
+        const Vector2& b = h.leafBodies[i]->worldAABBMax;
 
         mn.x = std::min(mn.x, a.x);
         mn.y = std::min(mn.y, a.y);
@@ -77,101 +147,1332 @@ BVHNode* BVHTree::buildRecursive(std::vector<RigidBody*>& bodies, int start, int
         mx.y = std::max(mx.y, b.y);
     }
 
-    node->minAABB = mn;
-    node->maxAABB = mx;
+    node.minAABB = mn;
+    node.maxAABB = mx;
 
+    int mid = (buildMode == BVHBuildMode::BINNED_SAH)
+                  ? splitBinnedSAH(h, start, end, mn, mx)
+                  : splitMedian(h, start, end, mn, mx);
+
+    int32_t left = buildRecursive(h, start, mid);
+    int32_t right = buildRecursive(h, mid, end);
+
+    BVHNode& parent = h.nodes[index];
+    parent.left = left;
+    parent.right = right;
+    parent.categoryBits = h.nodes[left].categoryBits | h.nodes[right].categoryBits;
+    parent.maskBits = h.nodes[left].maskBits | h.nodes[right].maskBits;
+
+    return index;
+}
+
+static inline float centroid(const RigidBody* b, int axis)
+{
+    return (b->worldAABBMin[axis] + b->worldAABBMax[axis]) * 0.5f;
+}
+
+static inline float perimeter(const Vector2& mn, const Vector2& mx)
+{
+    return 2.0f * ((mx.x - mn.x) + (mx.y - mn.y));
+}
+
+int BVHTree::splitMedian(BVHHierarchy& h, int start, int end, const Vector2& mn, const Vector2& mx)
+{
     float dx = mx.x - mn.x;
     float dy = mx.y - mn.y;
     int axis = (dx > dy) ? 0 : 1;
 
-    std::sort(bodies.begin() + start, bodies.begin() + end,
+    std::sort(h.leafBodies.begin() + start, h.leafBodies.begin() + end,
               [axis](RigidBody* A, RigidBody* B)
     {
-        float ca = (A->worldAABBMin[axis] + A->worldAABBMax[axis]) * 0.5f;
-        float cb = (B->worldAABBMin[axis] + B->worldAABBMax[axis]) * 0.5f;
-        return ca < cb;
+        return centroid(A, axis) < centroid(B, axis);
+    });
+
+    return start + (end - start) / 2;
+}
+
+namespace
+{
+    struct SAHBin
+    {
+        Vector2 minAABB;
+        Vector2 maxAABB;
+        int count;
+    };
+}
+
+int BVHTree::splitBinnedSAH(BVHHierarchy& h, int start, int end, const Vector2& mn, const Vector2& mx)
+{
+    const int binCount = std::clamp(sahBins, minSAHBins, maxSAHBins);
+
+    // bin on centroids, node bounds can be much wider than the centroid spread
+    Vector2 cmin(1e9f, 1e9f);
+    Vector2 cmax(-1e9f, -1e9f);
+    for (int i = start; i < end; i++)
+    {
+        float cx = centroid(h.leafBodies[i], 0);
+        float cy = centroid(h.leafBodies[i], 1);
+        cmin.x = std::min(cmin.x, cx);
+        cmin.y = std::min(cmin.y, cy);
+        cmax.x = std::max(cmax.x, cx);
+        cmax.y = std::max(cmax.y, cy);
+    }
+
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    int bestSplit = 0;
+
+    for (int axis = 0; axis < 2; axis++)
+    {
+        float extent = cmax[axis] - cmin[axis];
+        if (extent <= 1e-6f)
+            continue;
+
+        SAHBin bins[maxSAHBins];
+        for (int b = 0; b < binCount; b++)
+        {
+            bins[b].minAABB = Vector2(1e9f, 1e9f);
+            bins[b].maxAABB = Vector2(-1e9f, -1e9f);
+            bins[b].count = 0;
+        }
+
+        float scale = binCount / extent;
+        for (int i = start; i < end; i++)
+        {
+            const RigidBody* body = h.leafBodies[i];
+            int b = std::min(binCount - 1, (int)((centroid(body, axis) - cmin[axis]) * scale));
+
+            SAHBin& bin = bins[b];
+            bin.count++;
+            bin.minAABB.x = std::min(bin.minAABB.x, body->worldAABBMin.x);
+            bin.minAABB.y = std::min(bin.minAABB.y, body->worldAABBMin.y);
+            bin.maxAABB.x = std::max(bin.maxAABB.x, body->worldAABBMax.x);
+            bin.maxAABB.y = std::max(bin.maxAABB.y, body->worldAABBMax.y);
+        }
+
+        // sweep from the right to get the area and count of every suffix
+        float rightArea[maxSAHBins];
+        int rightCount[maxSAHBins];
+        Vector2 rmin(1e9f, 1e9f);
+        Vector2 rmax(-1e9f, -1e9f);
+        int count = 0;
+        for (int b = binCount - 1; b > 0; b--)
+        {
+            rmin.x = std::min(rmin.x, bins[b].minAABB.x);
+            rmin.y = std::min(rmin.y, bins[b].minAABB.y);
+            rmax.x = std::max(rmax.x, bins[b].maxAABB.x);
+            rmax.y = std::max(rmax.y, bins[b].maxAABB.y);
+            count += bins[b].count;
+            rightArea[b] = count ? perimeter(rmin, rmax) : 0.0f;
+            rightCount[b] = count;
+        }
+
+        // then from the left, split b puts bins [0, b) on the left
+        Vector2 lmin(1e9f, 1e9f);
+        Vector2 lmax(-1e9f, -1e9f);
+        count = 0;
+        for (int b = 1; b < binCount; b++)
+        {
+            lmin.x = std::min(lmin.x, bins[b - 1].minAABB.x);
+            lmin.y = std::min(lmin.y, bins[b - 1].minAABB.y);
+            lmax.x = std::max(lmax.x, bins[b - 1].maxAABB.x);
+            lmax.y = std::max(lmax.y, bins[b - 1].maxAABB.y);
+            count += bins[b - 1].count;
+
+            if (count == 0 || rightCount[b] == 0)
+                continue;
+
+            float cost = perimeter(lmin, lmax) * count + rightArea[b] * rightCount[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    // every centroid in the same spot, nothing to bin on
+    if (bestAxis < 0)
+        return splitMedian(h, start, end, mn, mx);
+
+    float scale = binCount / (cmax[bestAxis] - cmin[bestAxis]);
+    float origin = cmin[bestAxis];
+    auto midIt = std::partition(h.leafBodies.begin() + start, h.leafBodies.begin() + end,
+                                [&](RigidBody* body)
+    {
+        int b = std::min(binCount - 1, (int)((centroid(body, bestAxis) - origin) * scale));
+        return b < bestSplit;
     });
 
-    int mid = start + count / 2;
+    int mid = (int)(midIt - h.leafBodies.begin());
+    if (mid == start || mid == end)
+        return splitMedian(h, start, end, mn, mx);
+
+    return mid;
+}
+
+// LBVH
+
+// spreads the low 15 bits of v out to the even bits
+static inline uint32_t expandBits(uint32_t v)
+{
+    v &= 0x00007fff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+void BVHTree::buildLBVH(BVHHierarchy& h)
+{
+    const int count = (int)h.leafBodies.size();
+
+    Vector2 cmin(1e9f, 1e9f);
+    Vector2 cmax(-1e9f, -1e9f);
+
+    for (const RigidBody* b : h.leafBodies)
+    {
+        float cx = centroid(b, 0);
+        float cy = centroid(b, 1);
+        cmin.x = std::min(cmin.x, cx);
+        cmin.y = std::min(cmin.y, cy);
+        cmax.x = std::max(cmax.x, cx);
+        cmax.y = std::max(cmax.y, cy);
+    }
+
+    // 15 bits per axis, 30 bit codes
+    const float grid = 32767.0f;
+    const float sx = (cmax.x > cmin.x) ? grid / (cmax.x - cmin.x) : 0.0f;
+    const float sy = (cmax.y > cmin.y) ? grid / (cmax.y - cmin.y) : 0.0f;
 
-    node->left = buildRecursive(bodies, start, mid);
-    node->right = buildRecursive(bodies, mid, end);
+    mortonCodes.resize(count);
 
-    return node;
+    const int chunkCount = (count + lbvhTaskSize - 1) / lbvhTaskSize;
+    auto computeCodes = [&](int chunk)
+    {
+        int end = std::min(count, (chunk + 1) * lbvhTaskSize);
+        for (int i = chunk * lbvhTaskSize; i < end; i++)
+        {
+            const RigidBody* b = h.leafBodies[i];
+            uint32_t x = (uint32_t)((centroid(b, 0) - cmin.x) * sx);
+            uint32_t y = (uint32_t)((centroid(b, 1) - cmin.y) * sy);
+            mortonCodes[i] = (expandBits(x) << 1) | expandBits(y);
+        }
+    };
+
+    if (threadPool)
+        threadPool->parallelFor(chunkCount, computeCodes);
+    else
+    {
+        for (int c = 0; c < chunkCount; c++)
+            computeCodes(c);
+    }
+
+    sortMortonCodes(h);
+
+    // every subtree over [start, end) takes 2 * (end - start) - 1 nodes in
+    // depth-first order, so all node indices are known before anything is emitted
+    // and subtrees can be filled in independently
+    h.nodes.resize(2 * count - 1);
+
+    lbvhTasks.clear();
+    lbvhTopNodes.clear();
+    lbvhTasks.push_back({0, 0, count});
+
+    bool split = true;
+    while (split)
+    {
+        split = false;
+        lbvhScratch.clear();
+
+        for (const LBVHTask& t : lbvhTasks)
+        {
+            if (t.end - t.start <= lbvhTaskSize)
+            {
+                lbvhScratch.push_back(t);
+                continue;
+            }
+
+            int mid = findLBVHSplit(t.start, t.end);
+
+            BVHNode& node = h.nodes[t.node];
+            node.left = t.node + 1;
+            node.right = t.node + 2 * (mid - t.start);
+            node.body = -1;
+            lbvhTopNodes.push_back(t.node);
+
+            lbvhScratch.push_back({node.left, t.start, mid});
+            lbvhScratch.push_back({node.right, mid, t.end});
+            split = true;
+        }
+
+        lbvhTasks.swap(lbvhScratch);
+    }
+
+    auto emitTask = [&](int i)
+    {
+        const LBVHTask& t = lbvhTasks[i];
+        emitLBVH(h, t.node, t.start, t.end);
+    };
+
+    if (threadPool)
+        threadPool->parallelFor((int)lbvhTasks.size(), emitTask);
+    else
+    {
+        for (int i = 0; i < (int)lbvhTasks.size(); i++)
+            emitTask(i);
+    }
+
+    // top nodes were split parents first, so walking back finishes children first
+    for (int i = (int)lbvhTopNodes.size() - 1; i >= 0; i--)
+    {
+        BVHNode& node = h.nodes[lbvhTopNodes[i]];
+        mergeChildren(node, h.nodes[node.left], h.nodes[node.right]);
+    }
+}
+
+void BVHTree::sortMortonCodes(BVHHierarchy& h)
+{
+    const int count = (int)h.leafBodies.size();
+
+    mortonScratch.resize(count);
+    bodyScratch.resize(count);
+
+    uint32_t* codesIn = mortonCodes.data();
+    uint32_t* codesOut = mortonScratch.data();
+    RigidBody** bodiesIn = h.leafBodies.data();
+    RigidBody** bodiesOut = bodyScratch.data();
+
+    // LSD radix sort, 8 bits per pass. stable, so equal codes keep input order.
+    // an even number of passes leaves the result back in the original arrays
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t offsets[256] = {};
+        for (int i = 0; i < count; i++)
+            offsets[(codesIn[i] >> shift) & 0xff]++;
+
+        uint32_t sum = 0;
+        for (int d = 0; d < 256; d++)
+        {
+            uint32_t c = offsets[d];
+            offsets[d] = sum;
+            sum += c;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t dst = offsets[(codesIn[i] >> shift) & 0xff]++;
+            codesOut[dst] = codesIn[i];
+            bodiesOut[dst] = bodiesIn[i];
+        }
+
+        std::swap(codesIn, codesOut);
+        std::swap(bodiesIn, bodiesOut);
+    }
+}
+
+int BVHTree::findLBVHSplit(int start, int end) const
+{
+    const int last = end - 1;
+    const uint32_t first = mortonCodes[start];
+    const uint32_t lastCode = mortonCodes[last];
+
+    // identical codes, nothing to split on
+    if (first == lastCode)
+        return start + (end - start) / 2;
+
+    const int commonPrefix = std::countl_zero(first ^ lastCode);
+
+    // binary search for the last code that still shares more than commonPrefix bits with first
+    int split = start;
+    int step = last - start;
+
+    do
+    {
+        step = (step + 1) >> 1;
+        int candidate = split + step;
+
+        if (candidate < last && std::countl_zero(first ^ mortonCodes[candidate]) > commonPrefix)
+            split = candidate;
+    } while (step > 1);
+
+    return split + 1;
+}
+
+void BVHTree::emitLBVH(BVHHierarchy& h, int32_t index, int start, int end) const
+{
+    BVHNode& node = h.nodes[index];
+
+    if (end - start == 1)
+    {
+        node.left = nullNode;
+        node.right = nullNode;
+        node.body = start;
+        setLeaf(node, h.leafBodies[start]);
+        return;
+    }
+
+    int mid = findLBVHSplit(start, end);
+
+    node.left = index + 1;
+    node.right = index + 2 * (mid - start);
+    node.body = -1;
+
+    emitLBVH(h, node.left, start, mid);
+    emitLBVH(h, node.right, mid, end);
+
+    mergeChildren(node, h.nodes[node.left], h.nodes[node.right]);
+}
+
+void BVHTree::refit()
+{
+    // children always sit after their parent, so one backwards sweep is bottom-up
+    // static bodies don't move, only the dynamic tree needs it
+    std::vector<BVHNode>& nodes = tree.nodes;
+
+    for (int32_t i = (int32_t)nodes.size() - 1; i >= 0; i--)
+    {
+        BVHNode& node = nodes[i];
+
+        // filter bits are refreshed too, so changing a dynamic body's category takes effect next substep.
+        // the static tree is not refit, static bodies need invalidateStatic() after any edit
+        if (node.isLeaf())
+            setLeaf(node, tree.leafBodies[node.body]);
+        else
+            mergeChildren(node, nodes[node.left], nodes[node.right]);
+    }
+
+    if (!tree.wideNodes.empty())
+        refitWide(tree);
+}
+
+void BVHTree::beginStep(const std::vector<RigidBody*>& bodies)
+{
+    build(bodies);
+}
+
+void BVHTree::update(const std::vector<RigidBody*>& bodies)
+{
+    // a remove followed by an add keeps the count, so compare the list itself
+    if (bodies != trackedBodies)
+        build(bodies);
+    else
+        refit();
+
+    if (wideNodes && !tree.empty() && tree.wideNodes.empty())
+        collapseWide(tree);
+}
+
+real BVHTree::computeSAHCost() const
+{
+    const std::vector<BVHNode>& nodes = tree.nodes;
+    if (nodes.empty())
+        return 0.0f;
+
+    float rootArea = perimeter(nodes[0].minAABB, nodes[0].maxAABB);
+    if (rootArea <= 0.0f)
+        return 0.0f;
+
+    float cost = 0.0f;
+    for (const BVHNode& node : nodes)
+        cost += perimeter(node.minAABB, node.maxAABB);
+
+    return cost / rootArea;
 }
 
 void BVHTree::findPairs(std::vector<std::pair<RigidBody*, RigidBody*>>& outPairs)
 {
     outPairs.clear();
-    if (!root) return;
-    
-    queryPairs(root, outPairs);
+    overlapTests = 0;
+    if (tree.empty()) return;
+
+    if (wideNodes && !tree.wideNodes.empty())
+    {
+        findPairsWide(outPairs);
+        return;
+    }
+
+    // binary nodes only with wideNodes off, that path stays serial.
+    // dynamic vs dynamic, then dynamic vs static. static vs static is never tested
+    queryPairs(tree, 0, outPairs, overlapTests);
+
+    if (!staticTree.empty())
+        queryNodeAgainstTree(tree, 0, staticTree, 0, outPairs, overlapTests);
+}
+
+void BVHTree::queryPairs(const BVHHierarchy& h, int32_t node, std::vector<std::pair<RigidBody*, RigidBody*>>& outPairs,
+                         int& tests)
+{
+    const BVHNode& n = h.nodes[node];
+    if (n.isLeaf()) return;
+
+    // nothing in this subtree can collide with anything else in it
+    if (!CanPair(n.categoryBits, n.maskBits, n.categoryBits, n.maskBits)) return;
+
+    queryNodeAgainstTree(h, n.left, h, n.right, outPairs, tests);
+
+    queryPairs(h, n.left, outPairs, tests);
+    queryPairs(h, n.right, outPairs, tests);
+}
+
+void BVHTree::queryNodeAgainstTree(const BVHHierarchy& ha, int32_t nodeA, const BVHHierarchy& hb, int32_t nodeB,
+                                  std::vector<std::pair<RigidBody*, RigidBody*>>& outPairs, int& tests)
+{
+    const BVHNode& a = ha.nodes[nodeA];
+    const BVHNode& b = hb.nodes[nodeB];
+
+    if (!CanPair(a.categoryBits, a.maskBits, b.categoryBits, b.maskBits))
+        return;
+
+    tests++;
+    if (!AABBOverlap(a.minAABB, a.maxAABB, b.minAABB, b.maxAABB))
+        return;
+
+    if (a.isLeaf() && b.isLeaf())
+    {
+        RigidBody* bodyA = ha.leafBodies[a.body];
+        RigidBody* bodyB = hb.leafBodies[b.body];
+
+        if (bodyA->shouldCollide(*bodyB))
+            outPairs.push_back({bodyA, bodyB});
+        return;
+    }
+
+    if (a.isLeaf())
+    {
+        queryNodeAgainstTree(ha, nodeA, hb, b.left, outPairs, tests);
+        queryNodeAgainstTree(ha, nodeA, hb, b.right, outPairs, tests);
+    }
+    else if (b.isLeaf())
+    {
+        queryNodeAgainstTree(ha, a.left, hb, nodeB, outPairs, tests);
+        queryNodeAgainstTree(ha, a.right, hb, nodeB, outPairs, tests);
+    }
+    else
+    {
+        queryNodeAgainstTree(ha, a.left, hb, b.left, outPairs, tests);
+        queryNodeAgainstTree(ha, a.left, hb, b.right, outPairs, tests);
+        queryNodeAgainstTree(ha, a.right, hb, b.left, outPairs, tests);
+        queryNodeAgainstTree(ha, a.right, hb, b.right, outPairs, tests);
+    }
+}
+
+void BVHTree::query(const Vector2& minAABB, const Vector2& maxAABB, std::vector<RigidBody*>& out)
+{
+    if (wideNodes && !tree.wideNodes.empty())
+    {
+        queryHierarchyWide(tree, minAABB, maxAABB, out);
+        queryHierarchyWide(staticTree, minAABB, maxAABB, out);
+        return;
+    }
+
+    queryHierarchy(tree, minAABB, maxAABB, out);
+    queryHierarchy(staticTree, minAABB, maxAABB, out);
+}
+
+void BVHTree::queryHierarchy(const BVHHierarchy& h, const Vector2& minAABB, const Vector2& maxAABB, std::vector<RigidBody*>& out)
+{
+    if (h.empty()) return;
+
+    queryStack.clear();
+    queryStack.push_back(0);
+
+    while (!queryStack.empty())
+    {
+        const BVHNode& node = h.nodes[queryStack.back()];
+        queryStack.pop_back();
+
+        if (!AABBOverlap(node.minAABB, node.maxAABB, minAABB, maxAABB))
+            continue;
+
+        if (node.isLeaf())
+        {
+            RigidBody* body = h.leafBodies[node.body];
+            if (body->enableCollision)
+                out.push_back(body);
+            continue;
+        }
+
+        queryStack.push_back(node.right);
+        queryStack.push_back(node.left);
+    }
+}
+
+// Wide nodes
+
+// bit i set when child slot i overlaps [mn, mx]. unused slots are inverted boxes, but
+// infinite query bounds still match them, so they are masked off by count
+static inline int overlapMask4(const QBVHNode& n, const Vector2& mn, const Vector2& mx)
+{
+#if defined(__SSE__)
+    __m128 x = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(n.minX), _mm_set1_ps(mx.x)),
+                          _mm_cmpge_ps(_mm_load_ps(n.maxX), _mm_set1_ps(mn.x)));
+    __m128 y = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(n.minY), _mm_set1_ps(mx.y)),
+                          _mm_cmpge_ps(_mm_load_ps(n.maxY), _mm_set1_ps(mn.y)));
+    return _mm_movemask_ps(_mm_and_ps(x, y)) & ((1 << n.count) - 1);
+#else
+    int mask = 0;
+    for (int i = 0; i < n.count; i++)
+    {
+        if (n.minX[i] <= mx.x && n.maxX[i] >= mn.x && n.minY[i] <= mx.y && n.maxY[i] >= mn.y)
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+// bit i set when slot i's subtree can hold a body colliding with the given filter bits
+static inline int filterMask4(const QBVHNode& n, uint32_t category, uint32_t mask)
+{
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_cmpeq_epi32(_mm_and_si128(_mm_load_si128((const __m128i*)n.category), _mm_set1_epi32((int)mask)), zero);
+    __m128i b = _mm_cmpeq_epi32(_mm_and_si128(_mm_load_si128((const __m128i*)n.mask), _mm_set1_epi32((int)category)), zero);
+    return ~_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(a, b))) & 0xf;
+#else
+    int bits = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (CanPair(n.category[i], n.mask[i], category, mask))
+            bits |= 1 << i;
+    }
+    return bits;
+#endif
+}
+
+void BVHTree::collapseWide(BVHHierarchy& h)
+{
+    h.wideNodes.clear();
+    h.wideNodes.reserve(h.leafBodies.size() / 2 + 1);
+    collapseNode(h, 0);
+}
+
+int32_t BVHTree::collapseNode(BVHHierarchy& h, int32_t binaryNode)
+{
+    int32_t index = (int32_t)h.wideNodes.size();
+    h.wideNodes.push_back({});
+
+    int32_t slots[4];
+    int count = 0;
+
+    const BVHNode& root = h.nodes[binaryNode];
+    if (root.isLeaf())
+        slots[count++] = binaryNode;
+    else
+    {
+        slots[count++] = root.left;
+        slots[count++] = root.right;
+    }
+
+    // pull grandchildren up, always opening the biggest internal child
+    while (count < 4)
+    {
+        int best = -1;
+        float bestPerimeter = -1.0f;
+
+        for (int i = 0; i < count; i++)
+        {
+            const BVHNode& n = h.nodes[slots[i]];
+            if (n.isLeaf())
+                continue;
+
+            float p = perimeter(n.minAABB, n.maxAABB);
+            if (p > bestPerimeter)
+            {
+                bestPerimeter = p;
+                best = i;
+            }
+        }
+
+        if (best < 0)
+            break;
+
+        const BVHNode& n = h.nodes[slots[best]];
+        slots[best] = n.left;
+        slots[count++] = n.right;
+    }
+
+    int32_t children[4];
+    for (int i = 0; i < count; i++)
+    {
+        const BVHNode& n = h.nodes[slots[i]];
+        children[i] = n.isLeaf() ? ~n.body : collapseNode(h, slots[i]);
+    }
+
+    // wideNodes may have grown, take the reference only now
+    QBVHNode& w = h.wideNodes[index];
+    w.count = count;
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (i < count)
+        {
+            const BVHNode& n = h.nodes[slots[i]];
+            w.minX[i] = n.minAABB.x;
+            w.minY[i] = n.minAABB.y;
+            w.maxX[i] = n.maxAABB.x;
+            w.maxY[i] = n.maxAABB.y;
+            w.category[i] = n.categoryBits;
+            w.mask[i] = n.maskBits;
+            w.child[i] = children[i];
+        }
+        else
+        {
+            w.minX[i] = w.minY[i] = std::numeric_limits<float>::infinity();
+            w.maxX[i] = w.maxY[i] = -std::numeric_limits<float>::infinity();
+            w.category[i] = 0;
+            w.mask[i] = 0;
+            w.child[i] = 0;
+        }
+    }
+
+    return index;
+}
+
+void BVHTree::refitWide(BVHHierarchy& h)
+{
+    for (int32_t i = (int32_t)h.wideNodes.size() - 1; i >= 0; i--)
+    {
+        QBVHNode& w = h.wideNodes[i];
+
+        for (int s = 0; s < w.count; s++)
+        {
+            int32_t c = w.child[s];
+
+            if (QBVHNode::isLeaf(c))
+            {
+                const RigidBody* b = h.leafBodies[QBVHNode::leafIndex(c)];
+                w.minX[s] = b->worldAABBMin.x;
+                w.minY[s] = b->worldAABBMin.y;
+                w.maxX[s] = b->worldAABBMax.x;
+                w.maxY[s] = b->worldAABBMax.y;
+                LeafFilter(b, w.category[s], w.mask[s]);
+                continue;
+            }
+
+            // unused slots hold +inf / -inf so they drop out of the min / max
+            const QBVHNode& cw = h.wideNodes[c];
+            w.minX[s] = std::min(std::min(cw.minX[0], cw.minX[1]), std::min(cw.minX[2], cw.minX[3]));
+            w.minY[s] = std::min(std::min(cw.minY[0], cw.minY[1]), std::min(cw.minY[2], cw.minY[3]));
+            w.maxX[s] = std::max(std::max(cw.maxX[0], cw.maxX[1]), std::max(cw.maxX[2], cw.maxX[3]));
+            w.maxY[s] = std::max(std::max(cw.maxY[0], cw.maxY[1]), std::max(cw.maxY[2], cw.maxY[3]));
+            w.category[s] = cw.category[0] | cw.category[1] | cw.category[2] | cw.category[3];
+            w.mask[s] = cw.mask[0] | cw.mask[1] | cw.mask[2] | cw.mask[3];
+        }
+    }
 }
 
-void BVHTree::queryPairs(BVHNode* node, std::vector<std::pair<RigidBody*, RigidBody*>>& outPairs)
+BVHTree::WideSlot BVHTree::slotOf(const QBVHNode& w, int s)
 {
-    if (!node || !node->left || !node->right) return;
-    
-    queryNodeAgainstTree(node->left, node->right, outPairs);
-    
-    queryPairs(node->left, outPairs);
-    queryPairs(node->right, outPairs);
+    return {w.child[s], Vector2(w.minX[s], w.minY[s]), Vector2(w.maxX[s], w.maxY[s]), w.category[s], w.mask[s]};
+}
+
+// slots of w that overlap a and whose filter bits allow a pair with it
+static inline int candidateMask4(const QBVHNode& w, const Vector2& mn, const Vector2& mx, uint32_t category, uint32_t mask)
+{
+    return overlapMask4(w, mn, mx) & filterMask4(w, category, mask);
+}
+
+void BVHTree::selfPairsWide(const BVHHierarchy& h, int32_t node,
+                            std::vector<std::pair<RigidBody*, RigidBody*>>& outPairs, int& tests)
+{
+    const QBVHNode& w = h.wideNodes[node];
+
+    for (int i = 0; i < w.count; i++)
+    {
+        WideSlot a = slotOf(w, i);
+
+        // siblings after i only, each sibling pair once
+        tests += 4;
+        int bits = candidateMask4(w, a.minAABB, a.maxAABB, a.category, a.mask) & (0xe << i) & 0xf;
+
+        while (bits)
+        {
+            int j = std::countr_zero((unsigned)bits);
+            bits &= bits - 1;
+
+            crossPairsWide(h, a, h, slotOf(w, j), outPairs, tests);
+        }
+
+        if (!QBVHNode::isLeaf(a.child) && CanPair(a.category, a.mask, a.category, a.mask))
+            selfPairsWide(h, a.child, outPairs, tests);
+    }
 }
 
-void BVHTree::queryNodeAgainstTree(BVHNode* nodeA, BVHNode* nodeB, 
-                                  std::vector<std::pair<RigidBody*, RigidBody*>>& outPairs)
+// the caller has already checked that a and b overlap and pass the filter
+void BVHTree::crossPairsWide(const BVHHierarchy& ha, const WideSlot& a, const BVHHierarchy& hb, const WideSlot& b,
+                             std::vector<std::pair<RigidBody*, RigidBody*>>& outPairs, int& tests)
 {
-    if (!nodeA || !nodeB) return;
-    
-    if (!AABBOverlap(nodeA->minAABB, nodeA->maxAABB, nodeB->minAABB, nodeB->maxAABB))
+    const bool leafA = QBVHNode::isLeaf(a.child);
+    const bool leafB = QBVHNode::isLeaf(b.child);
+
+    if (leafA && leafB)
+    {
+        RigidBody* bodyA = ha.leafBodies[QBVHNode::leafIndex(a.child)];
+        RigidBody* bodyB = hb.leafBodies[QBVHNode::leafIndex(b.child)];
+
+        if (bodyA->shouldCollide(*bodyB))
+            outPairs.push_back({bodyA, bodyB});
+        return;
+    }
+
+    if (leafB)
+    {
+        const QBVHNode& wa = ha.wideNodes[a.child];
+
+        tests += 4;
+        int bits = candidateMask4(wa, b.minAABB, b.maxAABB, b.category, b.mask);
+        while (bits)
+        {
+            int s = std::countr_zero((unsigned)bits);
+            bits &= bits - 1;
+            crossPairsWide(ha, slotOf(wa, s), hb, b, outPairs, tests);
+        }
         return;
-    
-    if (nodeA->body && nodeB->body)
+    }
+
+    // b is a node, test a (or each of a's slots) against all of b's slots at once
+    const QBVHNode& wb = hb.wideNodes[b.child];
+
+    if (leafA)
     {
-        if (nodeA->body->enableCollision && nodeB->body->enableCollision)
-            outPairs.push_back({nodeA->body, nodeB->body});
+        tests += 4;
+        int bits = candidateMask4(wb, a.minAABB, a.maxAABB, a.category, a.mask);
+        while (bits)
+        {
+            int s = std::countr_zero((unsigned)bits);
+            bits &= bits - 1;
+            crossPairsWide(ha, a, hb, slotOf(wb, s), outPairs, tests);
+        }
         return;
     }
-    
-    if (nodeA->body)
+
+    const QBVHNode& wa = ha.wideNodes[a.child];
+
+    for (int i = 0; i < wa.count; i++)
     {
-        queryNodeAgainstTree(nodeA, nodeB->left, outPairs);
-        queryNodeAgainstTree(nodeA, nodeB->right, outPairs);
+        WideSlot sa = slotOf(wa, i);
+
+        tests += 4;
+        int bits = candidateMask4(wb, sa.minAABB, sa.maxAABB, sa.category, sa.mask);
+        while (bits)
+        {
+            int s = std::countr_zero((unsigned)bits);
+            bits &= bits - 1;
+            crossPairsWide(ha, sa, hb, slotOf(wb, s), outPairs, tests);
+        }
     }
-    else if (nodeB->body)
+}
+
+void BVHTree::splitWideTasks()
+{
+    // the roots have no parent slot, give them bounds and filters that pass everything
+    const WideSlot root = {0, Vector2(0.0f, 0.0f), Vector2(0.0f, 0.0f), ~0u, ~0u};
+    const WideSlot self = {selfTask, Vector2(0.0f, 0.0f), Vector2(0.0f, 0.0f), 0, 0};
+
+    wideTasks.clear();
+    wideTasks.push_back({&tree, root, nullptr, self});
+    if (!staticTree.wideNodes.empty())
+        wideTasks.push_back({&tree, root, &staticTree, root});
+
+    if ((int)tree.leafBodies.size() < parallelMinBodies)
+        return;
+
+    // open the top of the traversal breadth first, the same way each time
+    // so the task list only depends on the trees
+    bool split = true;
+    while (split && (int)wideTasks.size() < pairTaskTarget)
     {
-        queryNodeAgainstTree(nodeA->left, nodeB, outPairs);
-        queryNodeAgainstTree(nodeA->right, nodeB, outPairs);
+        split = false;
+        wideScratch.clear();
+
+        for (const WidePairTask& t : wideTasks)
+        {
+            if (t.b.child == selfTask)
+            {
+                const QBVHNode& w = t.ha->wideNodes[t.a.child];
+
+                for (int i = 0; i < w.count; i++)
+                {
+                    WideSlot a = slotOf(w, i);
+
+                    overlapTests += 4;
+                    int bits = candidateMask4(w, a.minAABB, a.maxAABB, a.category, a.mask) & (0xe << i) & 0xf;
+                    while (bits)
+                    {
+                        int j = std::countr_zero((unsigned)bits);
+                        bits &= bits - 1;
+                        wideScratch.push_back({t.ha, a, t.ha, slotOf(w, j)});
+                    }
+
+                    if (!QBVHNode::isLeaf(a.child) && CanPair(a.category, a.mask, a.category, a.mask))
+                        wideScratch.push_back({t.ha, a, nullptr, self});
+                }
+
+                split = true;
+                continue;
+            }
+
+            // open node vs node tasks only, anything with a leaf is already small
+            if (QBVHNode::isLeaf(t.a.child) || QBVHNode::isLeaf(t.b.child))
+            {
+                wideScratch.push_back(t);
+                continue;
+            }
+
+            const QBVHNode& wa = t.ha->wideNodes[t.a.child];
+            const QBVHNode& wb = t.hb->wideNodes[t.b.child];
+
+            for (int i = 0; i < wa.count; i++)
+            {
+                WideSlot sa = slotOf(wa, i);
+
+                overlapTests += 4;
+                int bits = candidateMask4(wb, sa.minAABB, sa.maxAABB, sa.category, sa.mask);
+                while (bits)
+                {
+                    int s = std::countr_zero((unsigned)bits);
+                    bits &= bits - 1;
+                    wideScratch.push_back({t.ha, sa, t.hb, slotOf(wb, s)});
+                }
+            }
+
+            split = true;
+        }
+
+        wideTasks.swap(wideScratch);
     }
+}
+
+void BVHTree::findPairsWide(std::vector<std::pair<RigidBody*, RigidBody*>>& outPairs)
+{
+    splitWideTasks();
+
+    const int taskCount = (int)wideTasks.size();
+    if ((int)taskPairs.size() < taskCount)
+        taskPairs.resize(taskCount);
+    taskTests.assign(taskCount, 0);
+
+    auto runTask = [this](int i)
+    {
+        const WidePairTask& t = wideTasks[i];
+        std::vector<std::pair<RigidBody*, RigidBody*>>& out = taskPairs[i];
+        out.clear();
+
+        int tests = 0;
+        if (t.b.child == selfTask)
+            selfPairsWide(*t.ha, t.a.child, out, tests);
+        else
+            crossPairsWide(*t.ha, t.a, *t.hb, t.b, out, tests);
+        taskTests[i] = tests;
+    };
+
+    if (threadPool && taskCount > 1)
+        threadPool->parallelFor(taskCount, runTask);
     else
     {
-        queryNodeAgainstTree(nodeA->left, nodeB->left, outPairs);
-        queryNodeAgainstTree(nodeA->left, nodeB->right, outPairs);
-        queryNodeAgainstTree(nodeA->right, nodeB->left, outPairs);
-        queryNodeAgainstTree(nodeA->right, nodeB->right, outPairs);
+        for (int i = 0; i < taskCount; i++)
+            runTask(i);
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < taskCount; i++)
+        total += taskPairs[i].size();
+    outPairs.reserve(total);
+
+    for (int i = 0; i < taskCount; i++)
+    {
+        outPairs.insert(outPairs.end(), taskPairs[i].begin(), taskPairs[i].end());
+        overlapTests += taskTests[i];
     }
 }
 
-// Visualization (same as before)
-static void drawNode(BVHNode* node)
+void BVHTree::queryHierarchyWide(const BVHHierarchy& h, const Vector2& minAABB, const Vector2& maxAABB,
+                                 std::vector<RigidBody*>& out)
 {
-    if (!node) return;
+    if (h.wideNodes.empty()) return;
+
+    queryStack.clear();
+    queryStack.push_back(0);
+
+    while (!queryStack.empty())
+    {
+        const QBVHNode& w = h.wideNodes[queryStack.back()];
+        queryStack.pop_back();
 
-    SDL_Color col = {255, 255, 0, 255}; // yellow
+        int mask = overlapMask4(w, minAABB, maxAABB);
 
-    Renderer2D::DrawAABBOutline(
-        node->minAABB.x,
-        node->minAABB.y,
-        node->maxAABB.x,
-        node->maxAABB.y,
-        col
-    );
+        while (mask)
+        {
+            int s = std::countr_zero((unsigned)mask);
+            mask &= mask - 1;
 
-    drawNode(node->left);
-    drawNode(node->right);
+            int32_t c = w.child[s];
+            if (!QBVHNode::isLeaf(c))
+            {
+                queryStack.push_back(c);
+                continue;
+            }
+
+            RigidBody* body = h.leafBodies[QBVHNode::leafIndex(c)];
+            if (body->enableCollision)
+                out.push_back(body);
+        }
+    }
+}
+
+// Casts
+
+void BVHTree::rayCast(const Vector2& origin, const Vector2& direction, real maxT, const Vector2& extent,
+                      BroadPhaseCastCallback& callback)
+{
+    Vector2 invDirection = InverseDirection(direction);
+    const bool wide = wideNodes && !tree.wideNodes.empty();
+
+    // whatever the dynamic tree hits first clips the search in the static one
+    maxT = wide ? castHierarchyWide(tree, origin, invDirection, maxT, extent, callback)
+                : castHierarchy(tree, origin, invDirection, maxT, extent, callback);
+    if (maxT <= 0.0f)
+        return;
+
+    if (wide)
+        castHierarchyWide(staticTree, origin, invDirection, maxT, extent, callback);
+    else
+        castHierarchy(staticTree, origin, invDirection, maxT, extent, callback);
+}
+
+real BVHTree::castHierarchy(const BVHHierarchy& h, const Vector2& origin, const Vector2& invDirection, real maxT,
+                            const Vector2& extent, BroadPhaseCastCallback& callback)
+{
+    if (h.empty()) return maxT;
+
+    real tEnter;
+    if (!RayOverlapsAABB(origin, invDirection, maxT, h.nodes[0].minAABB - extent, h.nodes[0].maxAABB + extent, tEnter))
+        return maxT;
+
+    castStack.clear();
+    castStack.push_back({0, tEnter});
+
+    while (!castStack.empty())
+    {
+        auto [index, t] = castStack.back();
+        castStack.pop_back();
+
+        // a closer hit came in after this node was pushed
+        if (t > maxT)
+            continue;
+
+        const BVHNode& node = h.nodes[index];
+
+        if (node.isLeaf())
+        {
+            RigidBody* body = h.leafBodies[node.body];
+            if (!body->enableCollision)
+                continue;
+
+            maxT = callback.reportBody(body, maxT);
+            if (maxT <= 0.0f)
+                return 0.0f;
+            continue;
+        }
+
+        const BVHNode& l = h.nodes[node.left];
+        const BVHNode& r = h.nodes[node.right];
+
+        real tl, tr;
+        bool hitL = RayOverlapsAABB(origin, invDirection, maxT, l.minAABB - extent, l.maxAABB + extent, tl);
+        bool hitR = RayOverlapsAABB(origin, invDirection, maxT, r.minAABB - extent, r.maxAABB + extent, tr);
+
+        // far child first so the near one is popped next
+        if (hitL && hitR && tl < tr)
+        {
+            castStack.push_back({node.right, tr});
+            castStack.push_back({node.left, tl});
+        }
+        else
+        {
+            if (hitL) castStack.push_back({node.left, tl});
+            if (hitR) castStack.push_back({node.right, tr});
+        }
+    }
+
+    return maxT;
+}
+
+// four rays traced together, lanes past the end of the batch have maxT < 0 and never hit
+struct alignas(16) BVHTree::RayPacket
+{
+    float originX[4];
+    float originY[4];
+    float invDirX[4];
+    float invDirY[4];
+    float maxT[4];
+
+    // bit i set when ray i reaches the box before its current maxT
+    int slab(const Vector2& mn, const Vector2& mx) const
+    {
+#if defined(__SSE__)
+        __m128 ox = _mm_load_ps(originX), oy = _mm_load_ps(originY);
+        __m128 ix = _mm_load_ps(invDirX), iy = _mm_load_ps(invDirY);
+
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mn.x), ox), ix);
+        __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mx.x), ox), ix);
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mn.y), oy), iy);
+        __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mx.y), oy), iy);
+
+        __m128 tMin = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)), _mm_setzero_ps());
+        __m128 tMax = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_load_ps(maxT));
+        return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax));
+#else
+        int mask = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            real t;
+            if (RayOverlapsAABB(Vector2(originX[i], originY[i]), Vector2(invDirX[i], invDirY[i]), maxT[i], mn, mx, t))
+                mask |= 1 << i;
+        }
+        return mask;
+#endif
+    }
+};
+
+void BVHTree::rayCastBatch(const CastRay* rays, CastHit* hits, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        hits[i].body = nullptr;
+        hits[i].t = rays[i].maxT;
+    }
+
+    RayPacket packet;
+
+    for (int base = 0; base < count; base += 4)
+    {
+        int lanes = std::min(4, count - base);
+
+        for (int i = 0; i < 4; i++)
+        {
+            const CastRay& ray = rays[base + std::min(i, lanes - 1)];
+            Vector2 inv = InverseDirection(ray.direction);
+
+            packet.originX[i] = ray.origin.x;
+            packet.originY[i] = ray.origin.y;
+            packet.invDirX[i] = inv.x;
+            packet.invDirY[i] = inv.y;
+            packet.maxT[i] = (i < lanes) ? ray.maxT : -1.0f;
+        }
+
+        // the static tree starts from whatever the dynamic one already hit
+        castPacket(tree, packet, rays + base, hits + base);
+        castPacket(staticTree, packet, rays + base, hits + base);
+    }
+}
+
+void BVHTree::castPacket(const BVHHierarchy& h, RayPacket& packet, const CastRay* rays, CastHit* hits)
+{
+    if (h.empty()) return;
+
+    // visit order follows the first ray, the packet is assumed to be roughly coherent
+    const Vector2 leadDirection = rays[0].direction;
+
+    queryStack.clear();
+    queryStack.push_back(0);
+
+    while (!queryStack.empty())
+    {
+        const BVHNode& node = h.nodes[queryStack.back()];
+        queryStack.pop_back();
+
+        int active = packet.slab(node.minAABB, node.maxAABB);
+        if (!active)
+            continue;
+
+        if (node.isLeaf())
+        {
+            RigidBody* body = h.leafBodies[node.body];
+            if (!body->enableCollision)
+                continue;
+
+            while (active)
+            {
+                int i = std::countr_zero((unsigned)active);
+                active &= active - 1;
+
+                CastHit hit;
+                if (CastCollision::RayBody(rays[i].origin, rays[i].direction, packet.maxT[i], body, hit))
+                {
+                    hits[i] = hit;
+                    packet.maxT[i] = hit.t;
+                }
+            }
+            continue;
+        }
+
+        const BVHNode& l = h.nodes[node.left];
+        const BVHNode& r = h.nodes[node.right];
+
+        // push the far child first
+        Vector2 delta = (r.minAABB + r.maxAABB) - (l.minAABB + l.maxAABB);
+        if (delta.scalarProduct(leadDirection) > 0.0f)
+        {
+            queryStack.push_back(node.right);
+            queryStack.push_back(node.left);
+        }
+        else
+        {
+            queryStack.push_back(node.left);
+            queryStack.push_back(node.right);
+        }
+    }
+}
+
+// bit i set when the ray reaches slot i grown by extent before maxT, entry t per slot in tEnter
+static inline int raySlab4(const QBVHNode& w, const Vector2& origin, const Vector2& invDirection, real maxT,
+                           const Vector2& extent, float tEnter[4])
+{
+#if defined(__SSE__)
+    const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y);
+    const __m128 ix = _mm_set1_ps(invDirection.x), iy = _mm_set1_ps(invDirection.y);
+    const __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y);
+
+    __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_load_ps(w.minX), ex), ox), ix);
+    __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_load_ps(w.maxX), ex), ox), ix);
+    __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_load_ps(w.minY), ey), oy), iy);
+    __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_load_ps(w.maxY), ey), oy), iy);
+
+    __m128 tMin = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)), _mm_setzero_ps());
+    __m128 tMax = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_set1_ps(maxT));
+
+    _mm_storeu_ps(tEnter, tMin);
+    return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax)) & ((1 << w.count) - 1);
+#else
+    int mask = 0;
+    for (int i = 0; i < w.count; i++)
+    {
+        if (RayOverlapsAABB(origin, invDirection, maxT,
+                            Vector2(w.minX[i], w.minY[i]) - extent, Vector2(w.maxX[i], w.maxY[i]) + extent, tEnter[i]))
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+real BVHTree::castHierarchyWide(const BVHHierarchy& h, const Vector2& origin, const Vector2& invDirection, real maxT,
+                                const Vector2& extent, BroadPhaseCastCallback& callback)
+{
+    if (h.wideNodes.empty()) return maxT;
+
+    castStack.clear();
+    castStack.push_back({0, 0.0f});
+
+    while (!castStack.empty())
+    {
+        auto [child, t] = castStack.back();
+        castStack.pop_back();
+
+        if (t > maxT)
+            continue;
+
+        if (QBVHNode::isLeaf(child))
+        {
+            RigidBody* body = h.leafBodies[QBVHNode::leafIndex(child)];
+            if (!body->enableCollision)
+                continue;
+
+            maxT = callback.reportBody(body, maxT);
+            if (maxT <= 0.0f)
+                return 0.0f;
+            continue;
+        }
+
+        const QBVHNode& w = h.wideNodes[child];
+
+        float tEnter[4];
+        int mask = raySlab4(w, origin, invDirection, maxT, extent, tEnter);
+
+        // push the hit slots far to near
+        size_t first = castStack.size();
+        while (mask)
+        {
+            int s = std::countr_zero((unsigned)mask);
+            mask &= mask - 1;
+
+            castStack.push_back({w.child[s], tEnter[s]});
+            for (size_t k = castStack.size() - 1; k > first && castStack[k - 1].second < castStack[k].second; k--)
+                std::swap(castStack[k - 1], castStack[k]);
+        }
+    }
+
+    return maxT;
+}
+
+void BVHTree::queryNearest(const Vector2& point, real maxDistance, BroadPhaseCastCallback& callback)
+{
+    nearestHeap.clear();
+
+    auto push = [&](const BVHHierarchy& h, int32_t index)
+    {
+        const BVHNode& node = h.nodes[index];
+        real d = SquaredDistanceToAABB(point, node.minAABB, node.maxAABB);
+        if (d > maxDistance * maxDistance)
+            return;
+
+        nearestHeap.push_back({d, &h, index});
+        std::push_heap(nearestHeap.begin(), nearestHeap.end(), std::greater<>());
+    };
+
+    // both roots share one heap so static and dynamic bodies come out in one distance order
+    if (!tree.empty()) push(tree, 0);
+    if (!staticTree.empty()) push(staticTree, 0);
+
+    while (!nearestHeap.empty())
+    {
+        std::pop_heap(nearestHeap.begin(), nearestHeap.end(), std::greater<>());
+        NearestEntry e = nearestHeap.back();
+        nearestHeap.pop_back();
+
+        // everything left is further away than the current radius
+        if (e.distanceSq > maxDistance * maxDistance)
+            return;
+
+        const BVHNode& node = e.h->nodes[e.node];
+
+        if (node.isLeaf())
+        {
+            RigidBody* body = e.h->leafBodies[node.body];
+            if (!body->enableCollision)
+                continue;
+
+            maxDistance = callback.reportBody(body, maxDistance);
+            if (maxDistance < 0.0f)
+                return;
+            continue;
+        }
+
+        push(*e.h, node.left);
+        push(*e.h, node.right);
+    }
+}
+
+// Visualization
+static void drawNodes(const std::vector<BVHNode>& nodes, SDL_Color col)
+{
+    for (const BVHNode& node : nodes)
+    {
+        Renderer2D::DrawAABBOutline(
+            node.minAABB.x,
+            node.minAABB.y,
+            node.maxAABB.x,
+            node.maxAABB.y,
+            col
+        );
+    }
 }
 
 void BVHTree::draw()
 {
-    drawNode(root);
-}
\ No newline at end of file
+    drawNodes(staticTree.nodes, {128, 128, 128, 255}); // grey
+    drawNodes(tree.nodes, {255, 255, 0, 255});         // yellow
+}
@@ -0,0 +1,81 @@
+#include <AccelEngine/BroadPhase.h>
+
+using namespace AccelEngine;
+
+void BroadPhase::rayCast(const Vector2 &origin, const Vector2 &direction, real maxT, const Vector2 &extent,
+                         BroadPhaseCastCallback &callback)
+{
+    // box around the whole cast, then a slab test on each candidate
+    Vector2 end = origin + direction * maxT;
+    Vector2 mn(std::min(origin.x, end.x) - extent.x, std::min(origin.y, end.y) - extent.y);
+    Vector2 mx(std::max(origin.x, end.x) + extent.x, std::max(origin.y, end.y) + extent.y);
+
+    castCandidates.clear();
+    query(mn, mx, castCandidates);
+
+    Vector2 invDirection = InverseDirection(direction);
+
+    for (RigidBody *body : castCandidates)
+    {
+        real tEnter;
+        if (!RayOverlapsAABB(origin, invDirection, maxT, body->worldAABBMin - extent, body->worldAABBMax + extent, tEnter))
+            continue;
+
+        maxT = callback.reportBody(body, maxT);
+        if (maxT <= 0.0f)
+            return;
+    }
+}
+
+namespace
+{
+    // keeps the nearest exact ray hit
+    class ClosestRayCallback : public BroadPhaseCastCallback
+    {
+    public:
+        ClosestRayCallback(const CastRay &ray, CastHit &hit) : ray(ray), hit(hit) {}
+
+        real reportBody(RigidBody *body, real maxT) override
+        {
+            CastHit h;
+            if (!CastCollision::RayBody(ray.origin, ray.direction, maxT, body, h))
+                return maxT;
+            hit = h;
+            return h.t;
+        }
+
+    private:
+        const CastRay &ray;
+        CastHit &hit;
+    };
+}
+
+void BroadPhase::rayCastBatch(const CastRay *rays, CastHit *hits, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        hits[i].body = nullptr;
+        hits[i].t = rays[i].maxT;
+
+        ClosestRayCallback callback(rays[i], hits[i]);
+        rayCast(rays[i].origin, rays[i].direction, rays[i].maxT, Vector2(0.0f, 0.0f), callback);
+    }
+}
+
+void BroadPhase::queryNearest(const Vector2 &point, real maxDistance, BroadPhaseCastCallback &callback)
+{
+    Vector2 extent(maxDistance, maxDistance);
+
+    castCandidates.clear();
+    query(point - extent, point + extent, castCandidates);
+
+    for (RigidBody *body : castCandidates)
+    {
+        if (SquaredDistanceToAABB(point, body->worldAABBMin, body->worldAABBMax) > maxDistance * maxDistance)
+            continue;
+
+        maxDistance = callback.reportBody(body, maxDistance);
+        if (maxDistance < 0.0f)
+            return;
+    }
+}
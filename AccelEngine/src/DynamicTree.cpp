@@ -0,0 +1,634 @@
+#include <AccelEngine/DynamicTree.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace AccelEngine;
+
+DynamicTree::DynamicTree() : root(nullNode), staticRoot(nullNode), freeList(nullNode), movedCount(0) {}
+
+bool DynamicTree::AABBOverlap(const Vector2 &minA, const Vector2 &maxA,
+                              const Vector2 &minB, const Vector2 &maxB)
+{
+    if (maxA.x < minB.x || minA.x > maxB.x) return false;
+    if (maxA.y < minB.y || minA.y > maxB.y) return false;
+    return true;
+}
+
+real DynamicTree::perimeter(const Vector2 &mn, const Vector2 &mx)
+{
+    return 2.0f * ((mx.x - mn.x) + (mx.y - mn.y));
+}
+
+static inline void combineAABB(const Vector2 &minA, const Vector2 &maxA,
+                               const Vector2 &minB, const Vector2 &maxB,
+                               Vector2 &outMin, Vector2 &outMax)
+{
+    outMin = Vector2(std::min(minA.x, minB.x), std::min(minA.y, minB.y));
+    outMax = Vector2(std::max(maxA.x, maxB.x), std::max(maxA.y, maxB.y));
+}
+
+// internal nodes carry the union of their children's bounds and filters
+static inline void combineChildren(const DynamicTreeNode &a, const DynamicTreeNode &b, DynamicTreeNode &out)
+{
+    combineAABB(a.minAABB, a.maxAABB, b.minAABB, b.maxAABB, out.minAABB, out.maxAABB);
+    out.categoryBits = a.categoryBits | b.categoryBits;
+    out.maskBits = a.maskBits | b.maskBits;
+}
+
+int DynamicTree::allocateNode()
+{
+    if (freeList == nullNode)
+    {
+        int oldCapacity = (int)nodes.size();
+        int newCapacity = oldCapacity == 0 ? 16 : oldCapacity * 2;
+        nodes.resize(newCapacity);
+
+        for (int i = oldCapacity; i < newCapacity; i++)
+        {
+            nodes[i].parent = (i + 1 < newCapacity) ? i + 1 : nullNode;
+            nodes[i].height = -1;
+        }
+        freeList = oldCapacity;
+    }
+
+    int nodeId = freeList;
+    DynamicTreeNode &node = nodes[nodeId];
+    freeList = node.parent;
+
+    node.parent = nullNode;
+    node.left = nullNode;
+    node.right = nullNode;
+    node.height = 0;
+    node.body = nullptr;
+    node.staticProxy = false;
+    return nodeId;
+}
+
+void DynamicTree::freeNode(int nodeId)
+{
+    nodes[nodeId].parent = freeList;
+    nodes[nodeId].height = -1;
+    nodes[nodeId].body = nullptr;
+    freeList = nodeId;
+}
+
+bool DynamicTree::refreshLeafFilter(int leaf)
+{
+    DynamicTreeNode &node = nodes[leaf];
+    uint32_t category, mask;
+    LeafFilter(node.body, category, mask);
+
+    if (category == node.categoryBits && mask == node.maskBits)
+        return false;
+
+    node.categoryBits = category;
+    node.maskBits = mask;
+    return true;
+}
+
+void DynamicTree::refreshAncestorFilters(int leaf)
+{
+    for (int index = nodes[leaf].parent; index != nullNode; index = nodes[index].parent)
+    {
+        DynamicTreeNode &node = nodes[index];
+        node.categoryBits = nodes[node.left].categoryBits | nodes[node.right].categoryBits;
+        node.maskBits = nodes[node.left].maskBits | nodes[node.right].maskBits;
+    }
+}
+
+void DynamicTree::fattenAABB(int leaf)
+{
+    DynamicTreeNode &node = nodes[leaf];
+    Vector2 margin(aabbMargin, aabbMargin);
+    node.minAABB = node.body->worldAABBMin - margin;
+    node.maxAABB = node.body->worldAABBMax + margin;
+}
+
+int DynamicTree::createProxy(RigidBody *body)
+{
+    int proxyId = allocateNode();
+    nodes[proxyId].body = body;
+    nodes[proxyId].staticProxy = body->isStatic();
+    refreshLeafFilter(proxyId);
+    fattenAABB(proxyId);
+    insertLeaf(proxyId);
+    return proxyId;
+}
+
+void DynamicTree::destroyProxy(int proxyId)
+{
+    removeLeaf(proxyId);
+    freeNode(proxyId);
+}
+
+bool DynamicTree::moveProxy(int proxyId)
+{
+    // filter edits only touch the ancestors' bits, the leaf stays where it is
+    if (refreshLeafFilter(proxyId))
+        refreshAncestorFilters(proxyId);
+
+    const DynamicTreeNode &node = nodes[proxyId];
+    const RigidBody *body = node.body;
+
+    // a body whose mass was changed by hand moves over to the other tree
+    if (node.staticProxy != body->isStatic())
+    {
+        removeLeaf(proxyId);
+        nodes[proxyId].staticProxy = body->isStatic();
+        fattenAABB(proxyId);
+        insertLeaf(proxyId);
+        return true;
+    }
+
+    if (body->worldAABBMin.x >= node.minAABB.x && body->worldAABBMin.y >= node.minAABB.y &&
+        body->worldAABBMax.x <= node.maxAABB.x && body->worldAABBMax.y <= node.maxAABB.y)
+        return false;
+
+    removeLeaf(proxyId);
+    fattenAABB(proxyId);
+    insertLeaf(proxyId);
+    return true;
+}
+
+void DynamicTree::update(const std::vector<RigidBody *> &bodies)
+{
+    movedCount = 0;
+
+    if (bodies != trackedBodies)
+        syncProxies(bodies);
+
+    for (int proxy : proxies)
+    {
+        if (moveProxy(proxy))
+            movedCount++;
+    }
+}
+
+void DynamicTree::syncProxies(const std::vector<RigidBody *> &bodies)
+{
+    // match proxies by body, so removing one body only touches that one leaf
+    proxyOf.clear();
+    for (size_t i = 0; i < trackedBodies.size(); i++)
+        proxyOf[trackedBodies[i]] = proxies[i];
+
+    scratchProxies.assign(bodies.size(), nullNode);
+    for (size_t i = 0; i < bodies.size(); i++)
+    {
+        auto it = proxyOf.find(bodies[i]);
+        if (it == proxyOf.end())
+            continue;
+
+        scratchProxies[i] = it->second;
+        proxyOf.erase(it);
+    }
+
+    // whatever is left was removed, free those nodes first so the new proxies reuse them
+    for (const auto &[body, proxy] : proxyOf)
+        destroyProxy(proxy);
+
+    for (size_t i = 0; i < bodies.size(); i++)
+    {
+        if (scratchProxies[i] == nullNode)
+            scratchProxies[i] = createProxy(bodies[i]);
+    }
+
+    trackedBodies.assign(bodies.begin(), bodies.end());
+    proxies.swap(scratchProxies);
+}
+
+void DynamicTree::clear()
+{
+    nodes.clear();
+    trackedBodies.clear();
+    proxies.clear();
+    proxyOf.clear();
+    root = nullNode;
+    staticRoot = nullNode;
+    freeList = nullNode;
+    movedCount = 0;
+}
+
+int DynamicTree::getHeight() const
+{
+    int height = 0;
+    if (root != nullNode)
+        height = nodes[root].height;
+    if (staticRoot != nullNode)
+        height = std::max(height, nodes[staticRoot].height);
+    return height;
+}
+
+void DynamicTree::insertLeaf(int leaf)
+{
+    int &treeRoot = rootOf(leaf);
+    if (treeRoot == nullNode)
+    {
+        treeRoot = leaf;
+        nodes[leaf].parent = nullNode;
+        return;
+    }
+
+    // walk down picking the child with the cheapest perimeter increase
+    Vector2 leafMin = nodes[leaf].minAABB;
+    Vector2 leafMax = nodes[leaf].maxAABB;
+    int index = treeRoot;
+
+    while (!nodes[index].isLeaf())
+    {
+        const DynamicTreeNode &node = nodes[index];
+        int left = node.left;
+        int right = node.right;
+
+        real area = perimeter(node.minAABB, node.maxAABB);
+
+        Vector2 combinedMin, combinedMax;
+        combineAABB(node.minAABB, node.maxAABB, leafMin, leafMax, combinedMin, combinedMax);
+        real combinedArea = perimeter(combinedMin, combinedMax);
+
+        // cost of making a new parent for this node and the new leaf
+        real cost = 2.0f * combinedArea;
+
+        // minimum cost of pushing the leaf further down the tree
+        real inheritanceCost = 2.0f * (combinedArea - area);
+
+        real costLeft, costRight;
+        {
+            Vector2 mn, mx;
+            combineAABB(leafMin, leafMax, nodes[left].minAABB, nodes[left].maxAABB, mn, mx);
+            costLeft = perimeter(mn, mx) + inheritanceCost;
+            if (!nodes[left].isLeaf())
+                costLeft -= perimeter(nodes[left].minAABB, nodes[left].maxAABB);
+        }
+        {
+            Vector2 mn, mx;
+            combineAABB(leafMin, leafMax, nodes[right].minAABB, nodes[right].maxAABB, mn, mx);
+            costRight = perimeter(mn, mx) + inheritanceCost;
+            if (!nodes[right].isLeaf())
+                costRight -= perimeter(nodes[right].minAABB, nodes[right].maxAABB);
+        }
+
+        if (cost < costLeft && cost < costRight)
+            break;
+
+        index = (costLeft < costRight) ? left : right;
+    }
+
+    int sibling = index;
+
+    // allocateNode can grow the node array, so no references are held across it
+    int oldParent = nodes[sibling].parent;
+    int newParent = allocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].body = nullptr;
+    combineChildren(nodes[leaf], nodes[sibling], nodes[newParent]);
+    nodes[newParent].height = nodes[sibling].height + 1;
+
+    if (oldParent != nullNode)
+    {
+        if (nodes[oldParent].left == sibling)
+            nodes[oldParent].left = newParent;
+        else
+            nodes[oldParent].right = newParent;
+    }
+    else
+    {
+        treeRoot = newParent;
+    }
+
+    nodes[newParent].left = sibling;
+    nodes[newParent].right = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    // walk back up fixing heights and bounds
+    index = nodes[leaf].parent;
+    while (index != nullNode)
+    {
+        index = balance(treeRoot, index);
+
+        int left = nodes[index].left;
+        int right = nodes[index].right;
+
+        nodes[index].height = 1 + std::max(nodes[left].height, nodes[right].height);
+        combineChildren(nodes[left], nodes[right], nodes[index]);
+
+        index = nodes[index].parent;
+    }
+}
+
+void DynamicTree::removeLeaf(int leaf)
+{
+    int &treeRoot = rootOf(leaf);
+    if (leaf == treeRoot)
+    {
+        treeRoot = nullNode;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+    if (grandParent == nullNode)
+    {
+        treeRoot = sibling;
+        nodes[sibling].parent = nullNode;
+        freeNode(parent);
+        return;
+    }
+
+    // hook the sibling straight onto the grandparent
+    if (nodes[grandParent].left == parent)
+        nodes[grandParent].left = sibling;
+    else
+        nodes[grandParent].right = sibling;
+    nodes[sibling].parent = grandParent;
+    freeNode(parent);
+
+    int index = grandParent;
+    while (index != nullNode)
+    {
+        index = balance(treeRoot, index);
+
+        int left = nodes[index].left;
+        int right = nodes[index].right;
+
+        combineChildren(nodes[left], nodes[right], nodes[index]);
+        nodes[index].height = 1 + std::max(nodes[left].height, nodes[right].height);
+
+        index = nodes[index].parent;
+    }
+}
+
+// Rotates the taller grandchild up when the subtree at A is out of balance.
+// Returns the index of the node now sitting where A was.
+int DynamicTree::balance(int &treeRoot, int iA)
+{
+    DynamicTreeNode &A = nodes[iA];
+    if (A.isLeaf() || A.height < 2)
+        return iA;
+
+    int iB = A.left;
+    int iC = A.right;
+    DynamicTreeNode &B = nodes[iB];
+    DynamicTreeNode &C = nodes[iC];
+
+    int diff = C.height - B.height;
+
+    // rotate C up
+    if (diff > 1)
+    {
+        int iF = C.left;
+        int iG = C.right;
+        DynamicTreeNode &F = nodes[iF];
+        DynamicTreeNode &G = nodes[iG];
+
+        C.left = iA;
+        C.parent = A.parent;
+        A.parent = iC;
+
+        if (C.parent != nullNode)
+        {
+            if (nodes[C.parent].left == iA)
+                nodes[C.parent].left = iC;
+            else
+                nodes[C.parent].right = iC;
+        }
+        else
+        {
+            treeRoot = iC;
+        }
+
+        if (F.height > G.height)
+        {
+            C.right = iF;
+            A.right = iG;
+            G.parent = iA;
+            combineChildren(B, G, A);
+            combineChildren(A, F, C);
+
+            A.height = 1 + std::max(B.height, G.height);
+            C.height = 1 + std::max(A.height, F.height);
+        }
+        else
+        {
+            C.right = iG;
+            A.right = iF;
+            F.parent = iA;
+            combineChildren(B, F, A);
+            combineChildren(A, G, C);
+
+            A.height = 1 + std::max(B.height, F.height);
+            C.height = 1 + std::max(A.height, G.height);
+        }
+
+        return iC;
+    }
+
+    // rotate B up
+    if (diff < -1)
+    {
+        int iD = B.left;
+        int iE = B.right;
+        DynamicTreeNode &D = nodes[iD];
+        DynamicTreeNode &E = nodes[iE];
+
+        B.left = iA;
+        B.parent = A.parent;
+        A.parent = iB;
+
+        if (B.parent != nullNode)
+        {
+            if (nodes[B.parent].left == iA)
+                nodes[B.parent].left = iB;
+            else
+                nodes[B.parent].right = iB;
+        }
+        else
+        {
+            treeRoot = iB;
+        }
+
+        if (D.height > E.height)
+        {
+            B.right = iD;
+            A.left = iE;
+            E.parent = iA;
+            combineChildren(C, E, A);
+            combineChildren(A, D, B);
+
+            A.height = 1 + std::max(C.height, E.height);
+            B.height = 1 + std::max(A.height, D.height);
+        }
+        else
+        {
+            B.right = iE;
+            A.left = iD;
+            D.parent = iA;
+            combineChildren(C, D, A);
+            combineChildren(A, E, B);
+
+            A.height = 1 + std::max(C.height, D.height);
+            B.height = 1 + std::max(A.height, E.height);
+        }
+
+        return iB;
+    }
+
+    return iA;
+}
+
+void DynamicTree::findPairs(std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs)
+{
+    outPairs.clear();
+    if (root == nullNode)
+        return;
+
+    // dynamic pairs among themselves, then against the static tree
+    queryPairs(root, outPairs);
+    if (staticRoot != nullNode)
+        queryNodeAgainstTree(root, staticRoot, outPairs);
+}
+
+void DynamicTree::queryPairs(int node, std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs)
+{
+    const DynamicTreeNode &n = nodes[node];
+    if (n.isLeaf())
+        return;
+
+    // nothing in this subtree can collide with anything else in it
+    if (!CanPair(n.categoryBits, n.maskBits, n.categoryBits, n.maskBits))
+        return;
+
+    queryNodeAgainstTree(nodes[node].left, nodes[node].right, outPairs);
+
+    queryPairs(nodes[node].left, outPairs);
+    queryPairs(nodes[node].right, outPairs);
+}
+
+void DynamicTree::queryNodeAgainstTree(int nodeA, int nodeB,
+                                       std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs)
+{
+    const DynamicTreeNode &a = nodes[nodeA];
+    const DynamicTreeNode &b = nodes[nodeB];
+
+    if (!CanPair(a.categoryBits, a.maskBits, b.categoryBits, b.maskBits))
+        return;
+
+    if (!AABBOverlap(a.minAABB, a.maxAABB, b.minAABB, b.maxAABB))
+        return;
+
+    if (a.isLeaf() && b.isLeaf())
+    {
+        RigidBody *bodyA = a.body;
+        RigidBody *bodyB = b.body;
+
+        // fat boxes overlap, only report pairs whose real bounds touch
+        if (bodyA->shouldCollide(*bodyB) &&
+            !(bodyA->isStatic() && bodyB->isStatic()) &&
+            AABBOverlap(bodyA->worldAABBMin, bodyA->worldAABBMax, bodyB->worldAABBMin, bodyB->worldAABBMax))
+            outPairs.push_back({bodyA, bodyB});
+        return;
+    }
+
+    // descend into the bigger node first
+    if (b.isLeaf() || (!a.isLeaf() && perimeter(a.minAABB, a.maxAABB) > perimeter(b.minAABB, b.maxAABB)))
+    {
+        queryNodeAgainstTree(a.left, nodeB, outPairs);
+        queryNodeAgainstTree(a.right, nodeB, outPairs);
+    }
+    else
+    {
+        queryNodeAgainstTree(nodeA, b.left, outPairs);
+        queryNodeAgainstTree(nodeA, b.right, outPairs);
+    }
+}
+
+void DynamicTree::query(const Vector2 &minAABB, const Vector2 &maxAABB, std::vector<RigidBody *> &out)
+{
+    queryStack.clear();
+    if (root != nullNode)
+        queryStack.push_back(root);
+    if (staticRoot != nullNode)
+        queryStack.push_back(staticRoot);
+
+    while (!queryStack.empty())
+    {
+        const DynamicTreeNode &node = nodes[queryStack.back()];
+        queryStack.pop_back();
+
+        if (!AABBOverlap(node.minAABB, node.maxAABB, minAABB, maxAABB))
+            continue;
+
+        if (node.isLeaf())
+        {
+            // leaf boxes are fat, check the real bounds
+            RigidBody *body = node.body;
+            if (body->enableCollision && AABBOverlap(body->worldAABBMin, body->worldAABBMax, minAABB, maxAABB))
+                out.push_back(body);
+            continue;
+        }
+
+        queryStack.push_back(node.right);
+        queryStack.push_back(node.left);
+    }
+}
+
+void DynamicTree::rayCast(const Vector2 &origin, const Vector2 &direction, real maxT, const Vector2 &extent,
+                          BroadPhaseCastCallback &callback)
+{
+    Vector2 invDirection = InverseDirection(direction);
+
+    real tEnter;
+    castStack.clear();
+    for (int r : {staticRoot, root})
+    {
+        if (r != nullNode &&
+            RayOverlapsAABB(origin, invDirection, maxT, nodes[r].minAABB - extent, nodes[r].maxAABB + extent, tEnter))
+            castStack.push_back({r, tEnter});
+    }
+
+    while (!castStack.empty())
+    {
+        auto [index, t] = castStack.back();
+        castStack.pop_back();
+
+        if (t > maxT)
+            continue;
+
+        const DynamicTreeNode &node = nodes[index];
+
+        if (node.isLeaf())
+        {
+            // leaf boxes are fat, check the real bounds
+            RigidBody *body = node.body;
+            if (!body->enableCollision ||
+                !RayOverlapsAABB(origin, invDirection, maxT, body->worldAABBMin - extent, body->worldAABBMax + extent, tEnter))
+                continue;
+
+            maxT = callback.reportBody(body, maxT);
+            if (maxT <= 0.0f)
+                return;
+            continue;
+        }
+
+        const DynamicTreeNode &l = nodes[node.left];
+        const DynamicTreeNode &r = nodes[node.right];
+
+        real tl, tr;
+        bool hitL = RayOverlapsAABB(origin, invDirection, maxT, l.minAABB - extent, l.maxAABB + extent, tl);
+        bool hitR = RayOverlapsAABB(origin, invDirection, maxT, r.minAABB - extent, r.maxAABB + extent, tr);
+
+        // far child first so the near one is popped next
+        if (hitL && hitR && tl < tr)
+        {
+            castStack.push_back({node.right, tr});
+            castStack.push_back({node.left, tl});
+        }
+        else
+        {
+            if (hitL) castStack.push_back({node.left, tl});
+            if (hitR) castStack.push_back({node.right, tr});
+        }
+    }
+}
@@ -0,0 +1,186 @@
+#include <AccelEngine/PairCache.h>
+#include <utility>
+
+using namespace AccelEngine;
+
+uint64_t PairCache::makeKey(const RigidBody *a, const RigidBody *b)
+{
+    uint64_t lo = a->bodyID;
+    uint64_t hi = b->bodyID;
+    if (lo > hi)
+        std::swap(lo, hi);
+    return (hi << 32) | lo;
+}
+
+uint32_t PairCache::home(uint64_t key) const
+{
+    // splitmix64 finalizer, consecutive IDs would otherwise cluster
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return (uint32_t)key & mask;
+}
+
+void PairCache::beginUpdate()
+{
+    for (uint64_t key : staleKeys)
+        erase(key);
+    staleKeys.clear();
+
+    stamp++;
+    addedCount = 0;
+    removedCount = 0;
+}
+
+CachedPair &PairCache::addPair(RigidBody *a, RigidBody *b, bool &isNew)
+{
+    // keep the load under one half so probe runs stay short
+    if ((count + 1) * 2 > slots.size())
+        grow();
+
+    uint64_t key = makeKey(a, b);
+    uint32_t i = home(key);
+
+    while (slots[i].key != emptyKey)
+    {
+        if (slots[i].key == key)
+        {
+            slots[i].pair.lastSeen = stamp;
+            isNew = false;
+            return slots[i].pair;
+        }
+        i = (i + 1) & mask;
+    }
+
+    if (a->bodyID > b->bodyID)
+        std::swap(a, b);
+
+    slots[i].key = key;
+    slots[i].pair = CachedPair{};
+    slots[i].pair.a = a;
+    slots[i].pair.b = b;
+    slots[i].pair.lastSeen = stamp;
+    count++;
+    addedCount++;
+
+    isNew = true;
+    return slots[i].pair;
+}
+
+CachedPair *PairCache::find(const RigidBody *a, const RigidBody *b)
+{
+    if (count == 0)
+        return nullptr;
+
+    uint64_t key = makeKey(a, b);
+    uint32_t i = home(key);
+
+    while (slots[i].key != emptyKey)
+    {
+        if (slots[i].key == key)
+            return &slots[i].pair;
+        i = (i + 1) & mask;
+    }
+    return nullptr;
+}
+
+void PairCache::removeStale(std::vector<CachedPair> &removed)
+{
+    // erasing shifts later slots back, which would move pairs the narrowphase still
+    // points at, so they are only collected here and erased by the next beginUpdate
+    staleKeys.clear();
+    for (const Slot &s : slots)
+    {
+        if (s.key != emptyKey && s.pair.lastSeen != stamp)
+        {
+            staleKeys.push_back(s.key);
+            removed.push_back(s.pair);
+        }
+    }
+
+    removedCount += (int)staleKeys.size();
+}
+
+void PairCache::removeBody(const RigidBody *body, std::vector<CachedPair> &removed)
+{
+    // settle what the last removeStale dropped, then reuse the list
+    for (uint64_t key : staleKeys)
+        erase(key);
+    staleKeys.clear();
+
+    for (const Slot &s : slots)
+    {
+        if (s.key != emptyKey && (s.pair.a == body || s.pair.b == body))
+        {
+            staleKeys.push_back(s.key);
+            removed.push_back(s.pair);
+        }
+    }
+
+    for (uint64_t key : staleKeys)
+        erase(key);
+    staleKeys.clear();
+}
+
+void PairCache::erase(uint64_t key)
+{
+    uint32_t i = home(key);
+    while (slots[i].key != key)
+        i = (i + 1) & mask;
+
+    // backward shift deletion: pull later entries of the run into the hole
+    // whenever their home slot does not lie between the hole and themselves
+    uint32_t hole = i;
+    uint32_t j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+        if (slots[j].key == emptyKey)
+            break;
+
+        uint32_t h = home(slots[j].key);
+        bool stays = (hole <= j) ? (hole < h && h <= j) : (hole < h || h <= j);
+        if (stays)
+            continue;
+
+        slots[hole] = slots[j];
+        hole = j;
+    }
+
+    slots[hole].key = emptyKey;
+    count--;
+}
+
+void PairCache::grow()
+{
+    std::vector<Slot> old;
+    old.swap(slots);
+
+    uint32_t capacity = old.empty() ? 64 : (uint32_t)old.size() * 2;
+    slots.assign(capacity, Slot{emptyKey, CachedPair{}});
+    mask = capacity - 1;
+    generation++;
+
+    for (const Slot &s : old)
+    {
+        if (s.key == emptyKey)
+            continue;
+
+        uint32_t i = home(s.key);
+        while (slots[i].key != emptyKey)
+            i = (i + 1) & mask;
+        slots[i] = s;
+    }
+}
+
+void PairCache::clear()
+{
+    for (Slot &s : slots)
+        s.key = emptyKey;
+    staleKeys.clear();
+    count = 0;
+    addedCount = 0;
+    removedCount = 0;
+}
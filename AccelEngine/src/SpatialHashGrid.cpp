@@ -0,0 +1,236 @@
+#include <AccelEngine/SpatialHashGrid.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace AccelEngine;
+
+int32_t SpatialHashGrid::cellCoord(real v) const
+{
+    // the float to int conversion is undefined out of range, NaN lands on the low end
+    real c = std::floor(v / cellSize);
+    if (!(c > (real)-cellLimit))
+        return -cellLimit;
+    if (c > (real)cellLimit)
+        return cellLimit;
+    return (int32_t)c;
+}
+
+uint32_t SpatialHashGrid::hashCell(int32_t cx, int32_t cy) const
+{
+    return (((uint32_t)cx * 73856093u) ^ ((uint32_t)cy * 19349663u)) & bucketMask;
+}
+
+void SpatialHashGrid::clear()
+{
+    trackedBodies.clear();
+    largeBodies.clear();
+    isLarge.clear();
+    entries.clear();
+    unsorted.clear();
+    bucketStart.clear();
+}
+
+void SpatialHashGrid::update(const std::vector<RigidBody *> &bodies)
+{
+    trackedBodies.assign(bodies.begin(), bodies.end());
+    unsorted.clear();
+    largeBodies.clear();
+    isLarge.assign(bodies.size(), 0);
+
+    minCellX = minCellY = cellLimit;
+    maxCellX = maxCellY = -cellLimit;
+
+    for (uint32_t i = 0; i < bodies.size(); i++)
+    {
+        const RigidBody *b = bodies[i];
+        if (!b->enableCollision)
+            continue;
+
+        int32_t x0 = cellCoord(b->worldAABBMin.x);
+        int32_t y0 = cellCoord(b->worldAABBMin.y);
+        int32_t x1 = std::max(cellCoord(b->worldAABBMax.x), x0);
+        int32_t y1 = std::max(cellCoord(b->worldAABBMax.y), y0);
+
+        if ((int64_t)(x1 - x0 + 1) * (y1 - y0 + 1) > maxBodyCells)
+        {
+            largeBodies.push_back(i);
+            isLarge[i] = 1;
+            continue;
+        }
+
+        minCellX = std::min(minCellX, x0);
+        minCellY = std::min(minCellY, y0);
+        maxCellX = std::max(maxCellX, x1);
+        maxCellY = std::max(maxCellY, y1);
+
+        for (int32_t y = y0; y <= y1; y++)
+            for (int32_t x = x0; x <= x1; x++)
+                unsorted.push_back({x, y, i});
+    }
+
+    // about two buckets per entry keeps hash collisions rare
+    uint32_t bucketCount = 1;
+    while (bucketCount < unsorted.size() * 2)
+        bucketCount <<= 1;
+    bucketMask = bucketCount - 1;
+
+    // counting sort by bucket
+    bucketStart.assign(bucketCount + 1, 0);
+    for (const Entry &e : unsorted)
+        bucketStart[hashCell(e.cellX, e.cellY) + 1]++;
+
+    for (uint32_t b = 0; b < bucketCount; b++)
+        bucketStart[b + 1] += bucketStart[b];
+
+    entries.resize(unsorted.size());
+    for (const Entry &e : unsorted)
+    {
+        // bucketStart[b] is used as the write cursor and ends up at the start of b + 1
+        uint32_t &cursor = bucketStart[hashCell(e.cellX, e.cellY)];
+        entries[cursor++] = e;
+    }
+
+    // shift the cursors back so bucketStart[b] is the start of bucket b again
+    for (uint32_t b = bucketCount; b > 0; b--)
+        bucketStart[b] = bucketStart[b - 1];
+    bucketStart[0] = 0;
+}
+
+static bool aabbsOverlap(const RigidBody *A, const RigidBody *B)
+{
+    return A->worldAABBMax.x >= B->worldAABBMin.x && A->worldAABBMin.x <= B->worldAABBMax.x &&
+           A->worldAABBMax.y >= B->worldAABBMin.y && A->worldAABBMin.y <= B->worldAABBMax.y;
+}
+
+void SpatialHashGrid::findPairs(std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs)
+{
+    outPairs.clear();
+
+    // large bodies against every body, two large bodies only from the lower index
+    for (uint32_t l : largeBodies)
+    {
+        RigidBody *A = trackedBodies[l];
+
+        for (uint32_t j = 0; j < trackedBodies.size(); j++)
+        {
+            if (isLarge[j] && j <= l)
+                continue;
+
+            RigidBody *B = trackedBodies[j];
+            if (!A->shouldCollide(*B) || (A->isStatic() && B->isStatic()) || !aabbsOverlap(A, B))
+                continue;
+
+            outPairs.push_back({A, B});
+        }
+    }
+
+    if (bucketStart.empty())
+        return;
+
+    uint32_t bucketCount = bucketMask + 1;
+
+    for (uint32_t b = 0; b < bucketCount; b++)
+    {
+        uint32_t begin = bucketStart[b];
+        uint32_t end = bucketStart[b + 1];
+
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const Entry &ei = entries[i];
+            RigidBody *A = trackedBodies[ei.body];
+
+            for (uint32_t j = i + 1; j < end; j++)
+            {
+                const Entry &ej = entries[j];
+
+                // different cells that hashed to the same bucket
+                if (ei.cellX != ej.cellX || ei.cellY != ej.cellY)
+                    continue;
+
+                RigidBody *B = trackedBodies[ej.body];
+                if (!A->shouldCollide(*B))
+                    continue;
+                if (A->isStatic() && B->isStatic())
+                    continue;
+
+                if (A->worldAABBMax.x < B->worldAABBMin.x || A->worldAABBMin.x > B->worldAABBMax.x)
+                    continue;
+                if (A->worldAABBMax.y < B->worldAABBMin.y || A->worldAABBMin.y > B->worldAABBMax.y)
+                    continue;
+
+                // two bodies can share several cells, only the cell holding the
+                // min corner of their overlap reports the pair
+                int32_t ox = cellCoord(std::max(A->worldAABBMin.x, B->worldAABBMin.x));
+                int32_t oy = cellCoord(std::max(A->worldAABBMin.y, B->worldAABBMin.y));
+                if (ox != ei.cellX || oy != ei.cellY)
+                    continue;
+
+                outPairs.push_back({A, B});
+            }
+        }
+    }
+}
+
+bool SpatialHashGrid::reportQuery(const Entry &e, const Vector2 &minAABB, const Vector2 &maxAABB) const
+{
+    const RigidBody *body = trackedBodies[e.body];
+    if (body->worldAABBMax.x < minAABB.x || body->worldAABBMin.x > maxAABB.x)
+        return false;
+    if (body->worldAABBMax.y < minAABB.y || body->worldAABBMin.y > maxAABB.y)
+        return false;
+
+    // same min corner rule as findPairs so a body is only reported once
+    return cellCoord(std::max(body->worldAABBMin.x, minAABB.x)) == e.cellX &&
+           cellCoord(std::max(body->worldAABBMin.y, minAABB.y)) == e.cellY;
+}
+
+void SpatialHashGrid::query(const Vector2 &minAABB, const Vector2 &maxAABB, std::vector<RigidBody *> &out)
+{
+    for (uint32_t l : largeBodies)
+    {
+        RigidBody *body = trackedBodies[l];
+        if (body->worldAABBMax.x < minAABB.x || body->worldAABBMin.x > maxAABB.x)
+            continue;
+        if (body->worldAABBMax.y < minAABB.y || body->worldAABBMin.y > maxAABB.y)
+            continue;
+        out.push_back(body);
+    }
+
+    if (bucketStart.empty())
+        return;
+
+    // nothing lives outside the occupied cells, which also bounds rays with a huge maxT
+    int32_t x0 = std::max(cellCoord(minAABB.x), minCellX);
+    int32_t y0 = std::max(cellCoord(minAABB.y), minCellY);
+    int32_t x1 = std::min(cellCoord(maxAABB.x), maxCellX);
+    int32_t y1 = std::min(cellCoord(maxAABB.y), maxCellY);
+
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    // a box over more cells than there are entries is cheaper to answer from the entries
+    if ((int64_t)(x1 - x0 + 1) * (y1 - y0 + 1) > (int64_t)entries.size())
+    {
+        for (const Entry &e : entries)
+        {
+            if (reportQuery(e, minAABB, maxAABB))
+                out.push_back(trackedBodies[e.body]);
+        }
+        return;
+    }
+
+    for (int32_t y = y0; y <= y1; y++)
+    {
+        for (int32_t x = x0; x <= x1; x++)
+        {
+            uint32_t b = hashCell(x, y);
+
+            for (uint32_t i = bucketStart[b]; i < bucketStart[b + 1]; i++)
+            {
+                const Entry &e = entries[i];
+                if (e.cellX == x && e.cellY == y && reportQuery(e, minAABB, maxAABB))
+                    out.push_back(trackedBodies[e.body]);
+            }
+        }
+    }
+}
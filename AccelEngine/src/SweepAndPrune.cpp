@@ -0,0 +1,151 @@
+#include <AccelEngine/SweepAndPrune.h>
+#include <algorithm>
+
+using namespace AccelEngine;
+
+// min endpoints go first on ties so touching boxes are reported, same as the BVH
+bool SweepAndPrune::lessThan(const Endpoint &a, const Endpoint &b)
+{
+    if (a.value != b.value)
+        return a.value < b.value;
+    return !a.isMax() && b.isMax();
+}
+
+void SweepAndPrune::clear()
+{
+    trackedBodies.clear();
+    endpoints.clear();
+    swapCount = 0;
+}
+
+void SweepAndPrune::rebuild(const std::vector<RigidBody *> &bodies)
+{
+    trackedBodies.assign(bodies.begin(), bodies.end());
+    sortedAxis = axis;
+
+    endpoints.resize(bodies.size() * 2);
+    for (uint32_t i = 0; i < bodies.size(); i++)
+    {
+        endpoints[2 * i] = {bodies[i]->worldAABBMin[axis], i << 1};
+        endpoints[2 * i + 1] = {bodies[i]->worldAABBMax[axis], (i << 1) | 1};
+    }
+
+    std::sort(endpoints.begin(), endpoints.end(), lessThan);
+}
+
+void SweepAndPrune::update(const std::vector<RigidBody *> &bodies)
+{
+    swapCount = 0;
+
+    // body indices are baked into the endpoints, so any change to the list means a full sort
+    if (bodies != trackedBodies || axis != sortedAxis)
+    {
+        rebuild(bodies);
+        return;
+    }
+
+    for (Endpoint &e : endpoints)
+    {
+        const RigidBody *b = trackedBodies[e.body()];
+        e.value = e.isMax() ? b->worldAABBMax[axis] : b->worldAABBMin[axis];
+    }
+
+    insertionSort();
+}
+
+void SweepAndPrune::insertionSort()
+{
+    for (size_t i = 1; i < endpoints.size(); i++)
+    {
+        Endpoint key = endpoints[i];
+        size_t j = i;
+
+        while (j > 0 && lessThan(key, endpoints[j - 1]))
+        {
+            endpoints[j] = endpoints[j - 1];
+            j--;
+        }
+
+        swapCount += (int)(i - j);
+        endpoints[j] = key;
+    }
+}
+
+void SweepAndPrune::findPairs(std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs)
+{
+    outPairs.clear();
+
+    const int other = 1 - sortedAxis;
+
+    active.clear();
+    activeSlot.resize(trackedBodies.size());
+
+    for (const Endpoint &e : endpoints)
+    {
+        uint32_t index = e.body();
+
+        if (e.isMax())
+        {
+            // a body with broken bounds (min > max) can close before it opened
+            uint32_t slot = activeSlot[index];
+            if (slot >= active.size() || active[slot] != index)
+                continue;
+
+            // swap-remove from the active list
+            uint32_t last = active.back();
+            active[slot] = last;
+            activeSlot[last] = slot;
+            active.pop_back();
+            continue;
+        }
+
+        RigidBody *body = trackedBodies[index];
+
+        if (body->enableCollision)
+        {
+            for (uint32_t otherIndex : active)
+            {
+                RigidBody *o = trackedBodies[otherIndex];
+                if (!body->shouldCollide(*o))
+                    continue;
+                if (body->isStatic() && o->isStatic())
+                    continue;
+
+                // already overlapping on the sweep axis, only the other one is left
+                if (body->worldAABBMax[other] < o->worldAABBMin[other] ||
+                    body->worldAABBMin[other] > o->worldAABBMax[other])
+                    continue;
+
+                outPairs.push_back({o, body});
+            }
+        }
+
+        activeSlot[index] = (uint32_t)active.size();
+        active.push_back(index);
+    }
+}
+
+void SweepAndPrune::query(const Vector2 &minAABB, const Vector2 &maxAABB, std::vector<RigidBody *> &out)
+{
+    const int other = 1 - sortedAxis;
+
+    // every body that can overlap has its min endpoint before the query max
+    for (const Endpoint &e : endpoints)
+    {
+        if (e.value > maxAABB[sortedAxis])
+            break;
+        if (e.isMax())
+            continue;
+
+        RigidBody *body = trackedBodies[e.body()];
+        if (!body->enableCollision)
+            continue;
+
+        if (body->worldAABBMax[sortedAxis] < minAABB[sortedAxis])
+            continue;
+        if (body->worldAABBMax[other] < minAABB[other] || body->worldAABBMin[other] > maxAABB[other])
+            continue;
+
+        out.push_back(body);
+    }
+}
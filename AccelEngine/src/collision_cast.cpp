@@ -0,0 +1,297 @@
+#include <AccelEngine/collision_cast.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace AccelEngine;
+
+static constexpr real castEpsilon = 1e-8f;
+
+// a cast that starts overlapping reports t = 0 with the normal facing back along the cast
+static Vector2 startNormal(const Vector2 &direction)
+{
+    Vector2 n = direction.normalized() * -1.0f;
+    if (n.x == 0.0f && n.y == 0.0f)
+        n = Vector2(0.0f, 1.0f);
+    return n;
+}
+
+Vector2 CastCollision::BoxExtent(const Matrix2 &rotation, const Vector2 &halfSize)
+{
+    return Vector2(std::abs(rotation.data[0]) * halfSize.x + std::abs(rotation.data[1]) * halfSize.y,
+                   std::abs(rotation.data[2]) * halfSize.x + std::abs(rotation.data[3]) * halfSize.y);
+}
+
+bool CastCollision::RayCircle(const Vector2 &origin, const Vector2 &direction, real maxT, const Vector2 &center, real radius,
+                              real &t, Vector2 &normal)
+{
+    Vector2 m = origin - center;
+    real c = m.scalarProduct(m) - radius * radius;
+
+    if (c <= 0.0f)
+    {
+        t = 0.0f;
+        normal = startNormal(direction);
+        return true;
+    }
+
+    real a = direction.scalarProduct(direction);
+    real b = m.scalarProduct(direction);
+
+    // outside and moving away
+    if (b >= 0.0f || a < castEpsilon)
+        return false;
+
+    real disc = b * b - a * c;
+    if (disc < 0.0f)
+        return false;
+
+    t = (-b - std::sqrt(disc)) / a;
+    if (t > maxT)
+        return false;
+
+    normal = (m + direction * t).normalized();
+    return true;
+}
+
+bool CastCollision::RayRoundedBox(const Vector2 &origin, const Vector2 &direction, real maxT, const Vector2 &center,
+                                  const Matrix2 &rotation, const Vector2 &halfSize, real radius, real &t, Vector2 &normal)
+{
+    // slab test in the box's local frame against the box grown by radius
+    Vector2 lo = rotation.transformTranspose(origin - center);
+    Vector2 ld = rotation.transformTranspose(direction);
+    Vector2 h(halfSize.x + radius, halfSize.y + radius);
+
+    real tEnter = -std::numeric_limits<real>::max();
+    real tExit = std::numeric_limits<real>::max();
+    int enterAxis = -1;
+    real enterSign = 0.0f;
+
+    for (int axis = 0; axis < 2; axis++)
+    {
+        if (std::abs(ld[axis]) < castEpsilon)
+        {
+            if (lo[axis] < -h[axis] || lo[axis] > h[axis])
+                return false;
+            continue;
+        }
+
+        real inv = 1.0f / ld[axis];
+        real t1 = (-h[axis] - lo[axis]) * inv;
+        real t2 = (h[axis] - lo[axis]) * inv;
+        real sign = -1.0f;
+
+        if (t1 > t2)
+        {
+            std::swap(t1, t2);
+            sign = 1.0f;
+        }
+
+        if (t1 > tEnter)
+        {
+            tEnter = t1;
+            enterAxis = axis;
+            enterSign = sign;
+        }
+        tExit = std::min(tExit, t2);
+
+        if (tEnter > tExit || tExit < 0.0f)
+            return false;
+    }
+
+    if (tEnter > maxT)
+        return false;
+
+    if (tEnter <= 0.0f)
+    {
+        // inside the grown box, but with rounded corners the origin may sit in a cut off corner
+        Vector2 q(std::abs(lo.x) - halfSize.x, std::abs(lo.y) - halfSize.y);
+        if (radius <= 0.0f || q.x <= 0.0f || q.y <= 0.0f || q.x * q.x + q.y * q.y <= radius * radius)
+        {
+            t = 0.0f;
+            normal = startNormal(direction);
+            return true;
+        }
+    }
+    else
+    {
+        Vector2 p = lo + ld * tEnter;
+
+        // entered through a flat face
+        if (radius <= 0.0f || std::abs(p.x) <= halfSize.x || std::abs(p.y) <= halfSize.y)
+        {
+            Vector2 ln(0.0f, 0.0f);
+            ln[enterAxis] = enterSign;
+            t = tEnter;
+            normal = rotation * ln;
+            return true;
+        }
+    }
+
+    // in a corner region, the rounded box is convex so the ray either hits that corner's circle or nothing
+    Vector2 corner(lo.x + ld.x * std::max(tEnter, 0.0f) > 0.0f ? halfSize.x : -halfSize.x,
+                   lo.y + ld.y * std::max(tEnter, 0.0f) > 0.0f ? halfSize.y : -halfSize.y);
+
+    Vector2 ln;
+    if (!RayCircle(lo, ld, maxT, corner, radius, t, ln))
+        return false;
+
+    normal = rotation * ln;
+    return true;
+}
+
+bool CastCollision::SweepBoxes(const Vector2 &centerA, const Matrix2 &rotationA, const Vector2 &halfA, const Vector2 &direction, real maxT,
+                               const Vector2 &centerB, const Matrix2 &rotationB, const Vector2 &halfB, real &t, Vector2 &normal, Vector2 &point)
+{
+    const Vector2 axes[4] = {
+        Vector2(rotationA.data[0], rotationA.data[2]),
+        Vector2(rotationA.data[1], rotationA.data[3]),
+        Vector2(rotationB.data[0], rotationB.data[2]),
+        Vector2(rotationB.data[1], rotationB.data[3])};
+
+    real tEnter = -std::numeric_limits<real>::max();
+    real tExit = std::numeric_limits<real>::max();
+    int enterAxis = -1;
+    Vector2 enterNormal;
+
+    for (int i = 0; i < 4; i++)
+    {
+        const Vector2 &n = axes[i];
+
+        real ra = halfA.x * std::abs(axes[0].scalarProduct(n)) + halfA.y * std::abs(axes[1].scalarProduct(n));
+        real rb = halfB.x * std::abs(axes[2].scalarProduct(n)) + halfB.y * std::abs(axes[3].scalarProduct(n));
+        real r = ra + rb;
+
+        // separation of the centers along n, shrinking by v per unit t
+        real s = (centerB - centerA).scalarProduct(n);
+        real v = direction.scalarProduct(n);
+
+        if (std::abs(v) < castEpsilon)
+        {
+            if (std::abs(s) > r)
+                return false;
+            continue;
+        }
+
+        real t1 = (s - r) / v;
+        real t2 = (s + r) / v;
+        if (t1 > t2)
+            std::swap(t1, t2);
+
+        if (t1 > tEnter)
+        {
+            tEnter = t1;
+            enterAxis = i;
+            // out of B, towards where A comes from
+            enterNormal = (s - v * t1 > 0.0f) ? n * -1.0f : n;
+        }
+        tExit = std::min(tExit, t2);
+
+        if (tEnter > tExit || tExit < 0.0f)
+            return false;
+    }
+
+    if (tEnter > maxT)
+        return false;
+
+    if (tEnter <= 0.0f || enterAxis < 0)
+    {
+        t = 0.0f;
+        normal = startNormal(direction);
+        point = centerB;
+        return true;
+    }
+
+    t = tEnter;
+    normal = enterNormal;
+
+    // a face of one box meets the deepest vertex of the other
+    Vector2 movedA = centerA + direction * t;
+    if (enterAxis >= 2)
+    {
+        Vector2 d = normal * -1.0f;
+        real sx = axes[0].scalarProduct(d) > 0.0f ? 1.0f : -1.0f;
+        real sy = axes[1].scalarProduct(d) > 0.0f ? 1.0f : -1.0f;
+        point = movedA + axes[0] * (halfA.x * sx) + axes[1] * (halfA.y * sy);
+    }
+    else
+    {
+        real sx = axes[2].scalarProduct(normal) > 0.0f ? 1.0f : -1.0f;
+        real sy = axes[3].scalarProduct(normal) > 0.0f ? 1.0f : -1.0f;
+        point = centerB + axes[2] * (halfB.x * sx) + axes[3] * (halfB.y * sy);
+    }
+    return true;
+}
+
+bool CastCollision::RayBody(const Vector2 &origin, const Vector2 &direction, real maxT, RigidBody *body, CastHit &hit)
+{
+    real t;
+    Vector2 n;
+
+    bool ok = (body->shapeType == ShapeType::CIRCLE)
+                  ? RayCircle(origin, direction, maxT, body->position, body->circle.radius, t, n)
+                  : RayRoundedBox(origin, direction, maxT, body->position, body->transformMatrix, body->aabb.halfSize, 0.0f, t, n);
+    if (!ok)
+        return false;
+
+    hit.body = body;
+    hit.t = t;
+    hit.normal = n;
+    hit.point = origin + direction * t;
+    return true;
+}
+
+bool CastCollision::CircleCastBody(const Vector2 &origin, real radius, const Vector2 &direction, real maxT, RigidBody *body, CastHit &hit)
+{
+    real t;
+    Vector2 n;
+
+    // the swept circle's center against the body grown by radius
+    bool ok = (body->shapeType == ShapeType::CIRCLE)
+                  ? RayCircle(origin, direction, maxT, body->position, body->circle.radius + radius, t, n)
+                  : RayRoundedBox(origin, direction, maxT, body->position, body->transformMatrix, body->aabb.halfSize, radius, t, n);
+    if (!ok)
+        return false;
+
+    hit.body = body;
+    hit.t = t;
+    hit.normal = n;
+    hit.point = origin + direction * t - n * radius;
+    return true;
+}
+
+bool CastCollision::BoxCastBody(const Vector2 &origin, const Vector2 &halfSize, real orientation, const Vector2 &direction, real maxT,
+                                RigidBody *body, CastHit &hit)
+{
+    Matrix2 rotation;
+    rotation.setOrientation(orientation);
+
+    real t;
+    Vector2 n;
+    Vector2 point;
+
+    if (body->shapeType == ShapeType::CIRCLE)
+    {
+        // same as the circle moving backwards into the box grown by its radius
+        Vector2 boxNormal;
+        if (!RayRoundedBox(body->position, direction * -1.0f, maxT, origin, rotation, halfSize, body->circle.radius, t, boxNormal))
+            return false;
+
+        n = boxNormal * -1.0f;
+        point = body->position + n * body->circle.radius;
+        if (t == 0.0f)
+        {
+            n = startNormal(direction);
+            point = body->position;
+        }
+    }
+    else if (!SweepBoxes(origin, rotation, halfSize, direction, maxT,
+                         body->position, body->transformMatrix, body->aabb.halfSize, t, n, point))
+        return false;
+
+    hit.body = body;
+    hit.t = t;
+    hit.normal = n;
+    hit.point = point;
+    return true;
+}
@@ -64,7 +64,10 @@ void CoarseCollision::FindPotentialPairs(const std::vector<RigidBody *> &bodies,
         maxA = bodies[i]->worldAABBMax;
         for (size_t j = i + 1; j < bodies.size(); ++j)
         {
-            if (!bodies[i]->enableCollision || !bodies[j]->enableCollision)
+            if (!bodies[i]->shouldCollide(*bodies[j]))
+                continue;
+            // two static bodies never need resolving
+            if (bodies[i]->isStatic() && bodies[j]->isStatic())
                 continue;
             minB = bodies[j]->worldAABBMin;
             maxB = bodies[j]->worldAABBMax;
@@ -75,3 +78,27 @@ void CoarseCollision::FindPotentialPairs(const std::vector<RigidBody *> &bodies,
         }
     }
 }
+
+void CoarseBroadPhase::update(const std::vector<RigidBody *> &bodies)
+{
+    trackedBodies.assign(bodies.begin(), bodies.end());
+}
+
+void CoarseBroadPhase::findPairs(std::vector<std::pair<RigidBody *, RigidBody *>> &outPairs)
+{
+    CoarseCollision::FindPotentialPairs(trackedBodies, outPairs);
+}
+
+void CoarseBroadPhase::query(const Vector2 &minAABB, const Vector2 &maxAABB, std::vector<RigidBody *> &out)
+{
+    for (RigidBody *b : trackedBodies)
+    {
+        if (b->enableCollision && AABBOverlap(b->worldAABBMin, b->worldAABBMax, minAABB, maxAABB))
+            out.push_back(b);
+    }
+}
+
+void CoarseBroadPhase::clear()
+{
+    trackedBodies.clear();
+}
@@ -1,99 +1,132 @@
 #include <AccelEngine/collision_narrow.h>
+#include <AccelEngine/ThreadPool.h>
 #include <limits>
 #include <cmath>
 #include <algorithm>
 #include <iostream>
+#include <bit>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 using namespace AccelEngine;
 
 static constexpr int verticesSize = 4;
 
-bool NarrowCollision::IntersectRectangles(const Vector2 *verticesA, Vector2 centera, const Vector2 *verticesB, Vector2 centerb, Contact &contacts)
+void NarrowCollision::ComputeEdgeNormals(const Vector2 *vertices, Vector2 *normals)
 {
-    Vector2 bestAxis(0, 0);
-    real bestDepth = std::numeric_limits<real>::max();
-
     for (int i = 0; i < verticesSize; i++)
     {
-        Vector2 va = verticesA[i];
-        Vector2 vb = verticesA[(i + 1) % verticesSize];
-
-        Vector2 edge = vb - va;
-        Vector2 axis(-edge.y, edge.x); 
+        Vector2 edge = vertices[(i + 1) % verticesSize] - vertices[i];
+        Vector2 axis(edge.y, -edge.x);
         real len = axis.magnitude();
-        if (len <= 1e-6f)
-            continue; 
 
-        auto minMaxA = projectOnAxis(verticesA, axis); 
-        auto minMaxB = projectOnAxis(verticesB, axis);
+        // degenerate edges get a zero normal and are skipped by the tests
+        normals[i] = len > 1e-6f ? axis / len : Vector2(0, 0);
+    }
+}
 
-        if (minMaxA.second < minMaxB.first || minMaxB.second < minMaxA.first)
-            return false;
+// signed distance of the deepest vertex of the other box below face i
+static inline real faceSeparation(const Vector2 *vertices1, const Vector2 *normals1, int i, const Vector2 *vertices2)
+{
+    const Vector2 &n = normals1[i];
 
-        real raw = std::min(minMaxB.second - minMaxA.first,
-                            minMaxA.second - minMaxB.first);
-        real depth = raw / len;
+    real separation = std::numeric_limits<real>::max();
+    for (int j = 0; j < verticesSize; j++)
+        separation = std::min(separation, n.scalarProduct(vertices2[j] - vertices1[i]));
+    return separation;
+}
 
-        if (depth < bestDepth)
-        {
-            bestDepth = depth;
-            bestAxis = axis;
-        }
-    }
+real NarrowCollision::FindMaxSeparation(const Vector2 *vertices1, const Vector2 *normals1, const Vector2 *vertices2, int &edge)
+{
+    real maxSeparation = std::numeric_limits<real>::lowest();
+    edge = 0;
 
     for (int i = 0; i < verticesSize; i++)
     {
-        Vector2 va = verticesB[i];
-        Vector2 vb = verticesB[(i + 1) % verticesSize];
-
-        Vector2 edge = vb - va;
-        Vector2 axis(-edge.y, edge.x);
-        real len = axis.magnitude();
-        if (len <= 1e-6f)
+        if (normals1[i].x == 0.0f && normals1[i].y == 0.0f)
             continue;
 
-        auto minMaxA = projectOnAxis(verticesA, axis);
-        auto minMaxB = projectOnAxis(verticesB, axis);
+        real separation = faceSeparation(vertices1, normals1, i, vertices2);
+        if (separation > maxSeparation)
+        {
+            maxSeparation = separation;
+            edge = i;
+        }
+    }
 
-        if (minMaxA.second < minMaxB.first || minMaxB.second < minMaxA.first)
+    return maxSeparation;
+}
+
+bool NarrowCollision::IntersectRectangles(const Vector2 *verticesA, const Vector2 *normalsA,
+                                          const Vector2 *verticesB, const Vector2 *normalsB, Contact &contacts,
+                                          SATCache *cache)
+{
+    // a face that separated the pair last step most likely still does
+    if (cache && cache->owner != SATCache::NONE)
+    {
+        bool ownerA = cache->owner == SATCache::A;
+        if (faceSeparation(ownerA ? verticesA : verticesB, ownerA ? normalsA : normalsB, cache->edge,
+                           ownerA ? verticesB : verticesA) > 0.0f)
             return false;
+    }
 
-        real raw = std::min(minMaxB.second - minMaxA.first,
-                            minMaxA.second - minMaxB.first);
-        real depth = raw / len;
+    // touching pairs start from scratch next time
+    if (cache)
+        cache->owner = SATCache::NONE;
 
-        if (depth < bestDepth)
-        {
-            bestDepth = depth;
-            bestAxis = axis;
-        }
+    int edgeA;
+    real separationA = FindMaxSeparation(verticesA, normalsA, verticesB, edgeA);
+    if (separationA > 0.0f)
+    {
+        if (cache)
+            *cache = {SATCache::A, (uint8_t)edgeA};
+        return false;
     }
 
-    Vector2 normal = bestAxis / bestAxis.magnitude(); 
-    real depth = bestDepth;                           
-    
-    Vector2 direction = centerb - centera;
-    if (direction.scalarProduct(normal) < 0.0f)
-        normal = normal * -1.0f;
+    int edgeB;
+    real separationB = FindMaxSeparation(verticesB, normalsB, verticesA, edgeB);
+    if (separationB > 0.0f)
+    {
+        if (cache)
+            *cache = {SATCache::B, (uint8_t)edgeB};
+        return false;
+    }
 
-    FindRectVsRectContact(verticesA, verticesB, contacts);
-    contacts.normal = normal;
-    contacts.penetration = depth;
-    return true;
+    // B's face has to be clearly better to become the reference, so near ties
+    // do not flip the manifold from one step to the next
+    constexpr real relativeTolerance = 0.98f;
+    constexpr real absoluteTolerance = 0.001f;
+
+    if (separationB > relativeTolerance * separationA + absoluteTolerance)
+    {
+        FindRectVsRectContact(verticesB, normalsB, edgeB, verticesA, normalsA, true, contacts);
+        contacts.normal = normalsB[edgeB] * -1.0f;
+        contacts.penetration = -separationB;
+    }
+    else
+    {
+        FindRectVsRectContact(verticesA, normalsA, edgeA, verticesB, normalsB, false, contacts);
+        contacts.normal = normalsA[edgeA];
+        contacts.penetration = -separationA;
+    }
+
+    return contacts.contactCount > 0;
 }
 
 bool NarrowCollision::IntersectCircles(Vector2 center1, real radius1, Vector2 center2, real radius2, Contact &contact)
 {
     Vector2 diff = center2 - center1;
-    real dist = (center1 - center2).magnitude();
+    real distSq = diff.squareMagnitude();
     real radii = radius1 + radius2;
 
-    if (dist > radii)
+    if (distSq > radii * radii)
     {
         return false;
     }
 
-    Vector2 normal = (center2 - center1).normalized();
+    real dist = std::sqrt(distSq);
+    Vector2 normal = dist > 0.0f ? diff * (1.0f / dist) : Vector2(0, 0);
     real depth = radii - dist;
 
     Vector2 contactPoint = center1 + normal * radius1;
@@ -102,25 +135,30 @@ bool NarrowCollision::IntersectCircles(Vector2 center1, real radius1, Vector2 ce
     contact.contactCount = 1;
     contact.normal = normal;
     contact.penetration = depth;
+    contact.features[0] = ContactFeature();
+    contact.pointPenetrations[0] = depth;
 
     return true;
 }
 
 bool NarrowCollision::IntersectCircleRectangle(Vector2 center1, real radius, Vector2 *vertices, Contact &contact)
+{
+    Vector2 normals[4];
+    ComputeEdgeNormals(vertices, normals);
+
+    return IntersectCircleRectangle(center1, radius, vertices, normals, contact);
+}
+
+bool NarrowCollision::IntersectCircleRectangle(Vector2 center1, real radius, const Vector2 *vertices, const Vector2 *normals, Contact &contact)
 {
     Vector2 normal(0, 0);
     real depth = std::numeric_limits<real>::max();
 
-    int verticesSize = 4;
-
     for (int i = 0; i < verticesSize; i++)
     {
-        Vector2 va = vertices[i];
-        Vector2 vb = vertices[(i + 1) % verticesSize];
-
-        Vector2 edge = vb - va;
-        Vector2 axis(-edge.y, edge.x);
-        axis.normalize();
+        Vector2 axis = normals[i];
+        if (axis.x == 0.0f && axis.y == 0.0f)
+            continue;
 
         std::pair<real, real> minMaxA = projectOnAxis(vertices, axis);
         std::pair<real, real> minMaxB = projectOnCircle(center1, radius, vertices, axis);
@@ -174,6 +212,8 @@ bool NarrowCollision::IntersectCircleRectangle(Vector2 center1, real radius, Vec
 
     contact.normal = normal;
     contact.penetration = depth;
+    contact.features[0] = ContactFeature();
+    contact.pointPenetrations[0] = depth;
 
     return true;
 }
@@ -268,76 +308,108 @@ void NarrowCollision::FindPointSegmentDistance(Vector2 center, Vector2 edge1, Ve
     distanceSquared = r * r;
 }
 
-void NarrowCollision::FindRectVsRectContact(const Vector2 *verticesA, const Vector2 *verticesB, Contact &contacts)
+namespace
 {
-    int contactCount = 0;
-    Vector2 contact1(0, 0);
-    Vector2 contact2(0, 0);
-    real minDistSq = std::numeric_limits<real>::max();
+    struct ClipVertex
+    {
+        Vector2 point;
+        ContactFeature feature;
+    };
 
-    for (int i = 0; i < verticesSize; i++)
+    // keeps the part of the segment where dot(normal, p) <= offset. a point made by
+    // the cut is tagged with the reference vertex whose side plane cut it
+    int clipSegmentToLine(ClipVertex out[2], const ClipVertex in[2], const Vector2 &normal, real offset, uint8_t vertexIndexA)
     {
-        Vector2 p = verticesA[i];
-        for (int j = 0; j < verticesSize; j++)
+        int count = 0;
+
+        real distance0 = normal.scalarProduct(in[0].point) - offset;
+        real distance1 = normal.scalarProduct(in[1].point) - offset;
+
+        if (distance0 <= 0.0f)
+            out[count++] = in[0];
+        if (distance1 <= 0.0f)
+            out[count++] = in[1];
+
+        if (distance0 * distance1 < 0.0f)
         {
-            Vector2 va = verticesB[j];
-            Vector2 vb = verticesB[(j + 1) % verticesSize];
-
-            real distSqrd;
-            Vector2 cp;
-
-            FindPointSegmentDistance(p, va, vb, distSqrd, cp);
-
-            if (Vector2::nearlyEqual(distSqrd, minDistSq))
-            {
-                if (!Vector2::nearlyEqual(cp, contact1))
-                {
-                    contact2 = cp;
-                    contactCount = 2;
-                }
-            }
-            else if (distSqrd < minDistSq)
-            {
-                minDistSq = distSqrd;
-                contactCount = 1;
-                contact1 = cp;
-            }
+            real t = distance0 / (distance0 - distance1);
+            out[count].point = in[0].point + (in[1].point - in[0].point) * t;
+            out[count].feature.indexA = vertexIndexA;
+            out[count].feature.indexB = in[0].feature.indexB;
+            out[count].feature.typeA = ContactFeature::VERTEX;
+            out[count].feature.typeB = ContactFeature::FACE;
+            count++;
         }
+
+        return count;
     }
+}
 
+void NarrowCollision::FindRectVsRectContact(const Vector2 *verticesRef, const Vector2 *normalsRef, int referenceEdge,
+                                            const Vector2 *verticesInc, const Vector2 *normalsInc, bool flip, Contact &contact)
+{
+    contact.contactCount = 0;
+
+    const Vector2 &normal = normalsRef[referenceEdge];
+
+    // incident edge: the one whose normal is most anti-parallel to the reference normal
+    int incidentEdge = 0;
+    real minDot = std::numeric_limits<real>::max();
     for (int i = 0; i < verticesSize; i++)
     {
-        Vector2 p = verticesB[i];
-        for (int j = 0; j < verticesSize; j++)
+        real d = normal.scalarProduct(normalsInc[i]);
+        if (d < minDot)
         {
-            Vector2 va = verticesA[j];
-            Vector2 vb = verticesA[(j + 1) % verticesSize];
-
-            real distSqrd;
-            Vector2 cp;
-
-            FindPointSegmentDistance(p, va, vb, distSqrd, cp);
-
-            if (Vector2::nearlyEqual(distSqrd, minDistSq))
-            {
-                if (!Vector2::nearlyEqual(cp, contact1))
-                {
-                    contact2 = cp;
-                    contactCount = 2;
-                }
-            }
-            else if (distSqrd < minDistSq)
-            {
-                minDistSq = distSqrd;
-                contactCount = 1;
-                contact1 = cp;
-            }
+            minDot = d;
+            incidentEdge = i;
         }
     }
 
-    contacts.contactPoints[0] = contact1;
-    contacts.contactPoints[1] = contact2;
-    contacts.contactCount = contactCount;
+    uint8_t ref1 = (uint8_t)referenceEdge;
+    uint8_t ref2 = (uint8_t)((referenceEdge + 1) % verticesSize);
+    uint8_t inc1 = (uint8_t)incidentEdge;
+    uint8_t inc2 = (uint8_t)((incidentEdge + 1) % verticesSize);
+
+    ClipVertex incident[2];
+    incident[0].point = verticesInc[inc1];
+    incident[0].feature = {ref1, inc1, ContactFeature::FACE, ContactFeature::VERTEX};
+    incident[1].point = verticesInc[inc2];
+    incident[1].feature = {ref1, inc2, ContactFeature::FACE, ContactFeature::VERTEX};
+
+    // counter clockwise winding, so the face runs along the normal turned left
+    Vector2 tangent(-normal.y, normal.x);
+    const Vector2 &v1 = verticesRef[ref1];
+    const Vector2 &v2 = verticesRef[ref2];
+
+    // clip the incident edge to the side planes of the reference face
+    ClipVertex clip1[2];
+    ClipVertex clip2[2];
+    if (clipSegmentToLine(clip1, incident, tangent * -1.0f, -tangent.scalarProduct(v1), ref1) < 2)
+        return;
+    if (clipSegmentToLine(clip2, clip1, tangent, tangent.scalarProduct(v2), ref2) < 2)
+        return;
+
+    // keep the points below or just above the reference face, placed halfway between the two surfaces
+    real frontOffset = normal.scalarProduct(v1);
+
+    for (int i = 0; i < 2; i++)
+    {
+        real separation = normal.scalarProduct(clip2[i].point) - frontOffset;
+        if (separation > speculativeDistance)
+            continue;
+
+        ContactFeature feature = clip2[i].feature;
+        if (flip)
+        {
+            std::swap(feature.indexA, feature.indexB);
+            std::swap(feature.typeA, feature.typeB);
+        }
+
+        int n = contact.contactCount++;
+        contact.contactPoints[n] = clip2[i].point - normal * (separation * 0.5f);
+        contact.features[n] = feature;
+        contact.pointPenetrations[n] = -separation;
+    }
 }
 
 void NarrowCollision::FindCircleVsRectangleContact(Vector2 center, real radius, Vector2 rectCenter, const Vector2 *verticesA, Contact &contact)
@@ -365,74 +437,436 @@ void NarrowCollision::FindCircleVsRectangleContact(Vector2 center, real radius,
     contact.contactCount = 1;
 }
 
+bool NarrowCollision::CollideBoxes(const RigidBody *A, const RigidBody *B, Contact &contact)
+{
+    return IntersectRectangles(A->worldVertices, A->worldNormals, B->worldVertices, B->worldNormals, contact);
+}
+
+bool NarrowCollision::CollideCircles(const RigidBody *A, const RigidBody *B, Contact &contact)
+{
+    return IntersectCircles(A->position, A->circle.radius, B->position, B->circle.radius, contact);
+}
+
+bool NarrowCollision::CollideCircleBox(const RigidBody *A, const RigidBody *B, Contact &contact)
+{
+    return IntersectCircleRectangle(A->position, A->circle.radius, B->worldVertices, B->worldNormals, contact);
+}
+
+// indexed [A's shape][B's shape], in ShapeType order
+static const NarrowCollision::CollideEntry collideTable[shapeTypeCount][shapeTypeCount] = {
+    /* CIRCLE */ {{NarrowCollision::CollideCircles, false}, {NarrowCollision::CollideCircleBox, false}},
+    /* AABB   */ {{NarrowCollision::CollideCircleBox, true}, {NarrowCollision::CollideBoxes, false}},
+};
+
+const NarrowCollision::CollideEntry &NarrowCollision::GetCollideEntry(ShapeType a, ShapeType b)
+{
+    return collideTable[(int)a][(int)b];
+}
+
+static inline bool runEntry(const NarrowCollision::CollideEntry &entry, RigidBody *A, RigidBody *B, Contact &contact)
+{
+    if (entry.swapped)
+    {
+        if (!entry.function(B, A, contact))
+            return false;
+        contact.normal = contact.normal * -1;
+    }
+    else if (!entry.function(A, B, contact))
+        return false;
+
+    contact.a = A;
+    contact.b = B;
+    return true;
+}
+
 bool NarrowCollision::SATCollision(const RigidBody *A, const RigidBody *B, Contact &contact)
 {
-    if (A->shapeType == ShapeType::AABB && B->shapeType == ShapeType::AABB)
+    return runEntry(GetCollideEntry(A->shapeType, B->shapeType),
+                    const_cast<RigidBody *>(A), const_cast<RigidBody *>(B), contact);
+}
+
+// pair indices grouped by shape pair, reused across calls
+static thread_local std::vector<uint32_t> bucketOrder;
+
+namespace
+{
+    // a run of pairs from one bucket, handed to one thread
+    struct NarrowTask
     {
-        Vector2 verticesA[4];
-        Vector2 verticesB[4];
+        int bucket;
+        uint32_t start;
+        uint32_t count;
+    };
+}
 
-        RigidBody::getTransformedVertices(A, verticesA);
-        RigidBody::getTransformedVertices(B, verticesB);
+static thread_local std::vector<NarrowTask> narrowTasks;
+static thread_local std::vector<std::vector<Contact>> taskContacts;
+static thread_local std::vector<int> taskCulled;
 
-        if (!IntersectRectangles(verticesA, A->position, verticesB, B->position, contact))
+using PairList = std::vector<std::pair<RigidBody *, RigidBody *>>;
+// returns how many pairs the bounding circle test rejected
+using BucketFunction = int (*)(const PairList &pairs, SATCache *satCache, const uint32_t *order, uint32_t count,
+                               std::vector<Contact> &contacts);
+
+// one instance per table entry so the collide call inlines into the loop
+template <CollideFunction Function, bool Swapped>
+static int collideBucket(const PairList &pairs, SATCache * /*satCache*/, const uint32_t *order, uint32_t count,
+                         std::vector<Contact> &contacts)
+{
+    int culled = 0;
+
+    for (uint32_t k = 0; k < count; k++)
+    {
+        RigidBody *A = pairs[order[k]].first;
+        RigidBody *B = pairs[order[k]].second;
+
+        Vector2 diff = B->position - A->position;
+        float rsum = A->boundingRadius + B->boundingRadius;
+
+        if (diff.scalarProduct(diff) > rsum * rsum)
         {
-            return false;
+            culled++;
+            continue;
         }
+
+        Contact c;
+        if (!(Swapped ? Function(B, A, c) : Function(A, B, c)))
+            continue;
+
+        if (Swapped)
+            c.normal = c.normal * -1;
+        c.a = A;
+        c.b = B;
+        c.pair = order[k];
+        contacts.push_back(c);
+    }
+
+    return culled;
+}
+
+// circle pairs are tested a block at a time in SoA form, as wide as the target allows
+#if defined(__AVX__)
+static constexpr uint32_t circleLanes = 8;
+#elif defined(__SSE2__)
+static constexpr uint32_t circleLanes = 4;
+#else
+static constexpr uint32_t circleLanes = 1;
+#endif
+
+struct alignas(32) CircleBlock
+{
+    float ax[circleLanes], ay[circleLanes], ar[circleLanes];
+    float bx[circleLanes], by[circleLanes], br[circleLanes];
+
+    // outputs, valid for the lanes in the returned mask
+    float dx[circleLanes], dy[circleLanes], dist[circleLanes];
+};
+
+// squared distance test on every lane, the sqrt only runs when some lane hits
+static inline int testCircleBlock(CircleBlock &block)
+{
+#if defined(__AVX__)
+    __m256 dx = _mm256_sub_ps(_mm256_load_ps(block.bx), _mm256_load_ps(block.ax));
+    __m256 dy = _mm256_sub_ps(_mm256_load_ps(block.by), _mm256_load_ps(block.ay));
+    __m256 radii = _mm256_add_ps(_mm256_load_ps(block.ar), _mm256_load_ps(block.br));
+    __m256 distSq = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+    int mask = _mm256_movemask_ps(_mm256_cmp_ps(distSq, _mm256_mul_ps(radii, radii), _CMP_LE_OQ));
+    if (mask)
+    {
+        _mm256_store_ps(block.dx, dx);
+        _mm256_store_ps(block.dy, dy);
+        _mm256_store_ps(block.dist, _mm256_sqrt_ps(distSq));
     }
-    else if (A->shapeType == ShapeType::CIRCLE && B->shapeType == ShapeType::CIRCLE)
+    return mask;
+#elif defined(__SSE2__)
+    __m128 dx = _mm_sub_ps(_mm_load_ps(block.bx), _mm_load_ps(block.ax));
+    __m128 dy = _mm_sub_ps(_mm_load_ps(block.by), _mm_load_ps(block.ay));
+    __m128 radii = _mm_add_ps(_mm_load_ps(block.ar), _mm_load_ps(block.br));
+    __m128 distSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+    int mask = _mm_movemask_ps(_mm_cmple_ps(distSq, _mm_mul_ps(radii, radii)));
+    if (mask)
     {
-        if (!IntersectCircles(A->position, A->circle.radius, B->position, B->circle.radius, contact))
+        _mm_store_ps(block.dx, dx);
+        _mm_store_ps(block.dy, dy);
+        _mm_store_ps(block.dist, _mm_sqrt_ps(distSq));
+    }
+    return mask;
+#else
+    block.dx[0] = block.bx[0] - block.ax[0];
+    block.dy[0] = block.by[0] - block.ay[0];
+    float radii = block.ar[0] + block.br[0];
+    float distSq = block.dx[0] * block.dx[0] + block.dy[0] * block.dy[0];
+    if (distSq > radii * radii)
+        return 0;
+    block.dist[0] = std::sqrt(distSq);
+    return 1;
+#endif
+}
+
+// same contact as IntersectCircles
+static inline void emitCircleContact(RigidBody *A, RigidBody *B, uint32_t pair, real dx, real dy, real dist,
+                                     std::vector<Contact> &contacts)
+{
+    real invDist = dist > 0.0f ? 1.0f / dist : 0.0f;
+
+    Contact &c = contacts.emplace_back();
+    c.a = A;
+    c.b = B;
+    c.normal = Vector2(dx * invDist, dy * invDist);
+    c.penetration = A->circle.radius + B->circle.radius - dist;
+    c.contactPoints[0] = A->position + c.normal * A->circle.radius;
+    c.contactCount = 1;
+    c.pointPenetrations[0] = c.penetration;
+    c.pair = pair;
+}
+
+// the bounding circles are the shapes here, so nothing is counted as culled
+static int collideCircleBucket(const PairList &pairs, SATCache * /*satCache*/, const uint32_t *order, uint32_t count,
+                               std::vector<Contact> &contacts)
+{
+    CircleBlock block;
+
+    // the tail is padded with copies of the last pair, their lanes are masked off
+    for (uint32_t k = 0; k < count; k += circleLanes)
+    {
+        uint32_t used = std::min(circleLanes, count - k);
+
+        for (uint32_t l = 0; l < circleLanes; l++)
         {
-            return false;
+            const auto &pair = pairs[order[k + std::min(l, used - 1)]];
+            block.ax[l] = pair.first->position.x;
+            block.ay[l] = pair.first->position.y;
+            block.ar[l] = pair.first->circle.radius;
+            block.bx[l] = pair.second->position.x;
+            block.by[l] = pair.second->position.y;
+            block.br[l] = pair.second->circle.radius;
+        }
+
+        int mask = testCircleBlock(block) & ((1 << used) - 1);
+        while (mask)
+        {
+            int l = std::countr_zero((unsigned)mask);
+            mask &= mask - 1;
+
+            const auto &pair = pairs[order[k + l]];
+            emitCircleContact(pair.first, pair.second, order[k + l], block.dx[l], block.dy[l], block.dist[l], contacts);
         }
     }
-    else if (A->shapeType == ShapeType::CIRCLE && B->shapeType == ShapeType::AABB)
+
+    return 0;
+}
+
+// box pairs test their cached separating face first when there is a cache
+static int collideBoxBucket(const PairList &pairs, SATCache *satCache, const uint32_t *order, uint32_t count,
+                            std::vector<Contact> &contacts)
+{
+    int culled = 0;
+
+    for (uint32_t k = 0; k < count; k++)
     {
-        Vector2 verts[4];
-        RigidBody::getTransformedVertices(B, verts);
+        RigidBody *A = pairs[order[k]].first;
+        RigidBody *B = pairs[order[k]].second;
 
-        if (!IntersectCircleRectangle(A->position, A->circle.radius, verts, contact))
-            return false;
+        Vector2 diff = B->position - A->position;
+        float rsum = A->boundingRadius + B->boundingRadius;
+
+        if (diff.scalarProduct(diff) > rsum * rsum)
+        {
+            culled++;
+            continue;
+        }
+
+        Contact c;
+        if (!NarrowCollision::IntersectRectangles(A->worldVertices, A->worldNormals, B->worldVertices, B->worldNormals,
+                                                  c, satCache ? &satCache[order[k]] : nullptr))
+            continue;
+
+        c.a = A;
+        c.b = B;
+        c.pair = order[k];
+        contacts.push_back(c);
     }
 
-    else if (A->shapeType == ShapeType::AABB && B->shapeType == ShapeType::CIRCLE)
+    return culled;
+}
+
+// same layout as collideTable
+static const BucketFunction bucketTable[shapeTypeCount][shapeTypeCount] = {
+    /* CIRCLE */ {collideCircleBucket, collideBucket<NarrowCollision::CollideCircleBox, false>},
+    /* AABB   */ {collideBucket<NarrowCollision::CollideCircleBox, true>, collideBoxBucket},
+};
+
+// splits the buckets into tasks for the pool, returns the bounding circle rejects
+static int findContactsParallel(const PairList &potentialPairs, SATCache *satCache, const uint32_t *bucketStart,
+                                ThreadPool &threadPool, std::vector<Contact> &contacts)
+{
+    constexpr int bucketCount = shapeTypeCount * shapeTypeCount;
+
+    // tasks never cross a bucket, so each one still runs a single collide loop
+    narrowTasks.clear();
+    for (int b = 0; b < bucketCount; b++)
     {
-        Vector2 verts[4];
-        RigidBody::getTransformedVertices(A, verts);
+        for (uint32_t start = bucketStart[b]; start < bucketStart[b + 1]; start += NarrowCollision::pairTaskSize)
+            narrowTasks.push_back({b, start, std::min(NarrowCollision::pairTaskSize, bucketStart[b + 1] - start)});
+    }
 
-        if (!IntersectCircleRectangle(B->position, B->circle.radius, verts, contact))
-            return false;
+    int taskCount = (int)narrowTasks.size();
+    if ((int)taskContacts.size() < taskCount)
+        taskContacts.resize(taskCount);
+    taskCulled.resize(taskCount);
 
-        contact.normal = contact.normal * -1;
+    // the scratch is thread_local, the workers have to go through the caller's copies
+    const NarrowTask *tasks = narrowTasks.data();
+    std::vector<Contact> *buffers = taskContacts.data();
+    const uint32_t *order = bucketOrder.data();
+
+    int *culled = taskCulled.data();
+
+    threadPool.parallelFor(taskCount, [&](int i)
+    {
+        const NarrowTask &t = tasks[i];
+        buffers[i].clear();
+        culled[i] = bucketTable[t.bucket / shapeTypeCount][t.bucket % shapeTypeCount](potentialPairs, satCache, order + t.start,
+                                                                                      t.count, buffers[i]);
+    });
+
+    size_t total = 0;
+    int totalCulled = 0;
+    for (int i = 0; i < taskCount; i++)
+    {
+        total += buffers[i].size();
+        totalCulled += culled[i];
     }
+    contacts.reserve(total);
 
-    contact.a = const_cast<RigidBody *>(A);
-    contact.b = const_cast<RigidBody *>(B);
-    // contact.contactCount = 0;
+    for (int i = 0; i < taskCount; i++)
+        contacts.insert(contacts.end(), buffers[i].begin(), buffers[i].end());
 
-    return true;
+    return totalCulled;
 }
 
 void NarrowCollision::FindContacts(
     const std::vector<std::pair<RigidBody *, RigidBody *>> &potentialPairs,
-    std::vector<Contact> &contacts)
+    std::vector<Contact> &contacts,
+    SATCache *satCache,
+    ThreadPool *threadPool,
+    NarrowPhaseStats *stats)
 {
+    constexpr int bucketCount = shapeTypeCount * shapeTypeCount;
+
     contacts.clear();
 
+    // counting sort of the pair indices by shape pair
+    uint32_t bucketStart[bucketCount + 1] = {};
     for (auto &pair : potentialPairs)
+        bucketStart[(int)pair.first->shapeType * shapeTypeCount + (int)pair.second->shapeType + 1]++;
+
+    for (int b = 0; b < bucketCount; b++)
+        bucketStart[b + 1] += bucketStart[b];
+
+    bucketOrder.resize(potentialPairs.size());
+
+    uint32_t cursor[bucketCount];
+    std::copy(bucketStart, bucketStart + bucketCount, cursor);
+
+    for (uint32_t i = 0; i < potentialPairs.size(); i++)
     {
-        RigidBody *A = pair.first;
-        RigidBody *B = pair.second;
+        const auto &pair = potentialPairs[i];
+        bucketOrder[cursor[(int)pair.first->shapeType * shapeTypeCount + (int)pair.second->shapeType]++] = i;
+    }
 
-        Vector2 diff = B->position - A->position;
-        float rsum = A->boundingRadius + B->boundingRadius;
+    int culled = 0;
 
-        if (diff.scalarProduct(diff) > rsum * rsum)
-            continue;
+    if (!threadPool || threadPool->getThreadCount() == 1 || potentialPairs.size() <= pairTaskSize)
+    {
+        for (int b = 0; b < bucketCount; b++)
+        {
+            uint32_t count = bucketStart[b + 1] - bucketStart[b];
+            if (count > 0)
+                culled += bucketTable[b / shapeTypeCount][b % shapeTypeCount](
+                    potentialPairs, satCache, bucketOrder.data() + bucketStart[b], count, contacts);
+        }
+    }
+    else
+    {
+        culled = findContactsParallel(potentialPairs, satCache, bucketStart, *threadPool, contacts);
+    }
 
-        Contact c;
-        if (SATCollision(pair.first, pair.second, c))
-            contacts.push_back(c);
+    if (stats)
+    {
+        stats->pairs = (int)potentialPairs.size();
+        stats->boundingCulled = culled;
+        stats->shapeTests = stats->pairs - culled;
+        stats->contacts = (int)contacts.size();
     }
 }
+
+
+bool NarrowCollision::PointInBody(const Vector2 &point, const RigidBody *body)
+{
+    if (body->shapeType == ShapeType::CIRCLE)
+        return (point - body->position).squareMagnitude() <= body->circle.radius * body->circle.radius;
+
+    Vector2 local = body->transformMatrix.transformTranspose(point - body->position);
+    return std::abs(local.x) <= body->aabb.halfSize.x && std::abs(local.y) <= body->aabb.halfSize.y;
+}
+
+bool NarrowCollision::CircleOverlapsBody(const Vector2 &center, real radius, const RigidBody *body)
+{
+    if (body->shapeType == ShapeType::CIRCLE)
+    {
+        real r = radius + body->circle.radius;
+        return (center - body->position).squareMagnitude() <= r * r;
+    }
+
+    // closest point of the box to the center, in box space
+    Vector2 local = body->transformMatrix.transformTranspose(center - body->position);
+    Vector2 clamped(std::clamp(local.x, -body->aabb.halfSize.x, body->aabb.halfSize.x),
+                    std::clamp(local.y, -body->aabb.halfSize.y, body->aabb.halfSize.y));
+
+    return (local - clamped).squareMagnitude() <= radius * radius;
+}
+
+bool NarrowCollision::AABBOverlapsBody(const Vector2 &minAABB, const Vector2 &maxAABB, const RigidBody *body)
+{
+    Vector2 center = (minAABB + maxAABB) * 0.5f;
+    Vector2 half = (maxAABB - minAABB) * 0.5f;
+
+    if (body->shapeType == ShapeType::CIRCLE)
+    {
+        Vector2 clamped(std::clamp(body->position.x, minAABB.x, maxAABB.x),
+                        std::clamp(body->position.y, minAABB.y, maxAABB.y));
+        return (body->position - clamped).squareMagnitude() <= body->circle.radius * body->circle.radius;
+    }
+
+    // the world axes are covered by the body's AABB already, only the box's own axes are left
+    if (body->worldAABBMax.x < minAABB.x || body->worldAABBMin.x > maxAABB.x ||
+        body->worldAABBMax.y < minAABB.y || body->worldAABBMin.y > maxAABB.y)
+        return false;
+
+    const Matrix2 &m = body->transformMatrix;
+    Vector2 d = center - body->position;
+
+    for (int i = 0; i < 2; i++)
+    {
+        Vector2 axis(m.data[i], m.data[2 + i]);
+        real projected = half.x * std::abs(axis.x) + half.y * std::abs(axis.y);
+        if (std::abs(d.scalarProduct(axis)) > projected + body->aabb.halfSize[i])
+            return false;
+    }
+    return true;
+}
+
+real NarrowCollision::DistanceToBody(const Vector2 &point, const RigidBody *body)
+{
+    if (body->shapeType == ShapeType::CIRCLE)
+        return std::max((point - body->position).magnitude() - body->circle.radius, (real)0.0f);
+
+    Vector2 local = body->transformMatrix.transformTranspose(point - body->position);
+    real dx = std::max(std::abs(local.x) - body->aabb.halfSize.x, (real)0.0f);
+    real dy = std::max(std::abs(local.y) - body->aabb.halfSize.y, (real)0.0f);
+    return std::sqrt(dx * dx + dy * dy);
+}
+
@@ -1,4 +1,5 @@
 #include <AccelEngine/collision_resolve.h>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 using namespace AccelEngine;
@@ -350,3 +351,242 @@ void CollisionResolve::Solve(Contact &contact, float dt)
     SolvePosition(contact);
     SolveVelocityWithRoatationAndFriction(contact);
 }
+
+
+// the same feature pair seen from the other body
+static uint32_t flipFeatureKey(uint32_t key)
+{
+    return ((key & 0xff) << 8) | ((key >> 8) & 0xff) | ((key & 0xff0000) << 8) | ((key >> 8) & 0xff0000);
+}
+
+void ContactSolver::applyImpulse(Constraint &c, const PointConstraint &p, const Vector2 &impulse)
+{
+    c.a->velocity -= impulse * c.inverseMassA;
+    c.a->rotation -= p.ra.cross(impulse) * c.inverseInertiaA;
+    c.b->velocity += impulse * c.inverseMassB;
+    c.b->rotation += p.rb.cross(impulse) * c.inverseInertiaB;
+}
+
+Vector2 ContactSolver::relativeVelocity(const Constraint &c, const PointConstraint &p)
+{
+    Vector2 velocityA = c.a->velocity + Vector2(-p.ra.y, p.ra.x) * c.a->rotation;
+    Vector2 velocityB = c.b->velocity + Vector2(-p.rb.y, p.rb.x) * c.b->rotation;
+    return velocityB - velocityA;
+}
+
+void ContactSolver::preSolve(const std::vector<Contact> &contacts, CachedPair *const *contactPairs, real dt)
+{
+    constraints.resize(contacts.size());
+
+    for (size_t i = 0; i < contacts.size(); i++)
+    {
+        const Contact &contact = contacts[i];
+        Constraint &c = constraints[i];
+
+        c.a = contact.a;
+        c.b = contact.b;
+        c.inverseMassA = c.a->lockPosition ? 0.0f : c.a->inverseMass;
+        c.inverseMassB = c.b->lockPosition ? 0.0f : c.b->inverseMass;
+        c.inverseInertiaA = c.a->lockRotation ? 0.0f : c.a->inverseInertia;
+        c.inverseInertiaB = c.b->lockRotation ? 0.0f : c.b->inverseInertia;
+
+        c.normal = contact.normal;
+        c.tangent = Vector2(c.normal.y, -c.normal.x);
+        c.friction = (c.a->staticFriction + c.b->staticFriction) * 0.5f;
+        real restitution = std::min(c.a->restitution, c.b->restitution);
+
+        c.pair = contactPairs ? contactPairs[i] : nullptr;
+        c.flipped = c.pair && c.pair->a != c.a;
+
+        c.pointCount = contact.contactCount;
+        for (int k = 0; k < c.pointCount; k++)
+        {
+            PointConstraint &p = c.points[k];
+            p.ra = contact.contactPoints[k] - c.a->position;
+            p.rb = contact.contactPoints[k] - c.b->position;
+
+            real raCrossN = p.ra.cross(c.normal);
+            real rbCrossN = p.rb.cross(c.normal);
+            real normalK = c.inverseMassA + c.inverseMassB + raCrossN * raCrossN * c.inverseInertiaA +
+                           rbCrossN * rbCrossN * c.inverseInertiaB;
+            p.normalMass = normalK > 0.0f ? 1.0f / normalK : 0.0f;
+
+            real raCrossT = p.ra.cross(c.tangent);
+            real rbCrossT = p.rb.cross(c.tangent);
+            real tangentK = c.inverseMassA + c.inverseMassB + raCrossT * raCrossT * c.inverseInertiaA +
+                            rbCrossT * rbCrossT * c.inverseInertiaB;
+            p.tangentMass = tangentK > 0.0f ? 1.0f / tangentK : 0.0f;
+
+            // a point still apart may close its gap within the substep but not push back
+            real penetration = contact.pointPenetrations[k];
+            if (penetration < 0.0f)
+                p.velocityBias = penetration / dt;
+            else
+                p.velocityBias = std::min(baumgarte / dt * std::max(penetration - slop, 0.0f), maxPushSpeed);
+
+            // a bounce already carries the bodies apart, adding the push out on top would gain energy
+            real approach = relativeVelocity(c, p).scalarProduct(c.normal);
+            if (approach < -restitutionThreshold)
+                p.velocityBias = std::max(p.velocityBias, -restitution * approach);
+
+            p.featureKey = c.flipped ? flipFeatureKey(contact.features[k].key()) : contact.features[k].key();
+            p.normalImpulse = 0.0f;
+            p.tangentImpulse = 0.0f;
+
+            if (!warmStarting || !c.pair)
+                continue;
+
+            // points where two boxes line up exactly can swap between a clipped and a vertex
+            // feature from one substep to the next, those fall back to the closest old point
+            int match = -1;
+            real closest = matchDistance * matchDistance;
+            for (int j = 0; j < c.pair->impulseCount; j++)
+            {
+                if (c.pair->featureKeys[j] == p.featureKey)
+                {
+                    match = j;
+                    break;
+                }
+
+                real distanceSq = (c.pair->impulsePoints[j] - contact.contactPoints[k]).squareMagnitude();
+                if (distanceSq < closest)
+                {
+                    closest = distanceSq;
+                    match = j;
+                }
+            }
+
+            if (match < 0)
+                continue;
+
+            // flipping a and b turns the normal and tangent around with them, the impulses stay
+            p.normalImpulse = c.pair->normalImpulses[match];
+            p.tangentImpulse = c.pair->tangentImpulses[match];
+        }
+
+        // two points solved one after the other push each other around and make stacks
+        // rock, so they get solved together unless the pair is close to singular
+        c.blockSolve = false;
+        if (c.pointCount == 2)
+        {
+            const PointConstraint &p1 = c.points[0];
+            const PointConstraint &p2 = c.points[1];
+            real ra1 = p1.ra.cross(c.normal), rb1 = p1.rb.cross(c.normal);
+            real ra2 = p2.ra.cross(c.normal), rb2 = p2.rb.cross(c.normal);
+            real mass = c.inverseMassA + c.inverseMassB;
+
+            c.k11 = mass + c.inverseInertiaA * ra1 * ra1 + c.inverseInertiaB * rb1 * rb1;
+            c.k22 = mass + c.inverseInertiaA * ra2 * ra2 + c.inverseInertiaB * rb2 * rb2;
+            c.k12 = mass + c.inverseInertiaA * ra1 * ra2 + c.inverseInertiaB * rb1 * rb2;
+
+            constexpr real maxConditionNumber = 1000.0f;
+            c.blockSolve = c.k11 * c.k11 < maxConditionNumber * (c.k11 * c.k22 - c.k12 * c.k12);
+        }
+    }
+
+    // only now, so every approach speed above was read before any warm start impulse
+    // moved the bodies. in a stack those add up to a bounce on resting contacts
+    for (Constraint &c : constraints)
+    {
+        for (int k = 0; k < c.pointCount; k++)
+        {
+            const PointConstraint &p = c.points[k];
+            applyImpulse(c, p, c.normal * p.normalImpulse + c.tangent * p.tangentImpulse);
+        }
+    }
+}
+
+void ContactSolver::solveBlock(Constraint &c)
+{
+    PointConstraint &p1 = c.points[0];
+    PointConstraint &p2 = c.points[1];
+
+    // both points at once: find x >= 0 with K x + b >= 0 and x . (K x + b) = 0,
+    // trying the four ways each point can be active or not
+    real a1 = p1.normalImpulse;
+    real a2 = p2.normalImpulse;
+    real b1 = relativeVelocity(c, p1).scalarProduct(c.normal) - p1.velocityBias - (c.k11 * a1 + c.k12 * a2);
+    real b2 = relativeVelocity(c, p2).scalarProduct(c.normal) - p2.velocityBias - (c.k12 * a1 + c.k22 * a2);
+
+    real det = c.k11 * c.k22 - c.k12 * c.k12;
+    real x1 = -(c.k22 * b1 - c.k12 * b2) / det;
+    real x2 = -(c.k11 * b2 - c.k12 * b1) / det;
+
+    if (x1 < 0.0f || x2 < 0.0f)
+    {
+        x1 = -b1 / c.k11;
+        x2 = 0.0f;
+        if (x1 < 0.0f || c.k12 * x1 + b2 < 0.0f)
+        {
+            x1 = 0.0f;
+            x2 = -b2 / c.k22;
+            if (x2 < 0.0f || c.k12 * x2 + b1 < 0.0f)
+            {
+                // no combination holds, which only happens through round off. leave the impulses as they are
+                if (b1 < 0.0f || b2 < 0.0f)
+                    return;
+                x2 = 0.0f;
+            }
+        }
+    }
+
+    applyImpulse(c, p1, c.normal * (x1 - a1));
+    applyImpulse(c, p2, c.normal * (x2 - a2));
+    p1.normalImpulse = x1;
+    p2.normalImpulse = x2;
+}
+
+void ContactSolver::solve()
+{
+    for (int it = 0; it < iterations; it++)
+    {
+        for (Constraint &c : constraints)
+        {
+            // friction first, the normal impulses are the ones that have to hold at the end
+            for (int k = 0; k < c.pointCount; k++)
+            {
+                PointConstraint &p = c.points[k];
+
+                real tangentSpeed = relativeVelocity(c, p).scalarProduct(c.tangent);
+                real maxFriction = c.friction * p.normalImpulse;
+                real tangentImpulse = std::clamp(p.tangentImpulse - tangentSpeed * p.tangentMass, -maxFriction, maxFriction);
+                applyImpulse(c, p, c.tangent * (tangentImpulse - p.tangentImpulse));
+                p.tangentImpulse = tangentImpulse;
+            }
+
+            if (c.blockSolve)
+            {
+                solveBlock(c);
+                continue;
+            }
+
+            for (int k = 0; k < c.pointCount; k++)
+            {
+                PointConstraint &p = c.points[k];
+
+                real normalSpeed = relativeVelocity(c, p).scalarProduct(c.normal);
+                real normalImpulse = std::max(p.normalImpulse + (p.velocityBias - normalSpeed) * p.normalMass, 0.0f);
+                applyImpulse(c, p, c.normal * (normalImpulse - p.normalImpulse));
+                p.normalImpulse = normalImpulse;
+            }
+        }
+    }
+}
+
+void ContactSolver::storeImpulses()
+{
+    for (const Constraint &c : constraints)
+    {
+        if (!c.pair)
+            continue;
+
+        c.pair->impulseCount = c.pointCount;
+        for (int k = 0; k < c.pointCount; k++)
+        {
+            c.pair->featureKeys[k] = c.points[k].featureKey;
+            c.pair->impulsePoints[k] = c.a->position + c.points[k].ra;
+            c.pair->normalImpulses[k] = c.points[k].normalImpulse;
+            c.pair->tangentImpulses[k] = c.points[k].tangentImpulse;
+        }
+    }
+}
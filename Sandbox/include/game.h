@@ -34,6 +34,8 @@ public:
     Vector2 ScreenToWorld(const Vector2 &s, float screenHeight);
     Vector2 getMouseWorld();
     void eraseAt(float mx, float my);
+    // the first movable body under the point, bodies with collision disabled included
+    RigidBody *pickBody(const Vector2 &point);
 
     void gradBodies(float mx, float my);
     void addCircle(float x, float y);
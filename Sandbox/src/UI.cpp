@@ -146,14 +146,25 @@ void UI::DrawAddBody(World &world, std::vector<RigidBody *> &bodies)
 
         ImGui::Text("Body %d", selectedIndex);
 
-        ImGui::Checkbox("Enable Collision", &b->enableCollision);
+        bool shapeEdited = false;
+        shapeEdited |= ImGui::Checkbox("Enable Collision", &b->enableCollision);
+        shapeEdited |= ImGui::InputScalar("Category", ImGuiDataType_U32, &b->categoryBits, nullptr, nullptr, "%08X", ImGuiInputTextFlags_CharsHexadecimal);
+        shapeEdited |= ImGui::InputScalar("Mask", ImGuiDataType_U32, &b->maskBits, nullptr, nullptr, "%08X", ImGuiInputTextFlags_CharsHexadecimal);
+        shapeEdited |= ImGui::InputInt("Group", &b->groupIndex);
 
-        ImGui::DragFloat2("Position", (float*)&b->position, 0.5f);
+        shapeEdited |= ImGui::DragFloat2("Position", (float*)&b->position, 0.5f);
 
         float degrees = b->orientation * 180.0f / 3.14159265f;
-        ImGui::DragFloat("Rotation (deg)", &degrees, 0.2f, -180.f, 180.f, "%.2f");
+        shapeEdited |= ImGui::DragFloat("Rotation (deg)", &degrees, 0.2f, -180.f, 180.f, "%.2f");
         b->orientation = degrees * 3.14159265f / 180.f;
 
+        // the BVH builds its static tree once and never refits it
+        if (shapeEdited && b->isStatic())
+        {
+            if (BVHTree *bvh = dynamic_cast<BVHTree *>(&world.getBroadPhase()))
+                bvh->invalidateStatic();
+        }
+
         ImGui::DragFloat2("Velocity", (float*)&b->velocity, 0.2f);
         ImGui::DragFloat("Angular Vel", &b->rotation, 0.1f);
         ImGui::DragFloat("Angular Damping", &b->angularDamping, 0.01f, 0.f, 1.f);
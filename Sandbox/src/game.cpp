@@ -142,7 +142,8 @@
             }
         }
 
-        const int substeps = 50;
+        // the contact solver iterates and warm starts, a few substeps keep stacks standing
+        const int substeps = 8;
         const real h = dt / (real)substeps;
 
         Uint64 startPhysics = SDL_GetPerformanceCounter();
@@ -192,7 +193,7 @@
         SDL_RenderClear(renderer);
 
         if (showBVH)
-            world.broadPhase.draw();
+            world.getBroadPhase().draw();
 
         for (auto *b : bodies)
         {
@@ -245,6 +246,14 @@
                 ImGui::SetItemDefaultFocus();
         }
 
+        ImGui::Separator();
+        ImGui::Text("Broadphase");
+
+        static const char *broadPhaseNames[] = {"Dynamic Tree", "BVH", "Sweep and Prune", "Spatial Hash", "Coarse (n^2)"};
+        int broadPhaseIndex = (int)world.getBroadPhaseType();
+        if (ImGui::Combo("##broadphase", &broadPhaseIndex, broadPhaseNames, IM_ARRAYSIZE(broadPhaseNames)))
+            world.setBroadPhase((BroadPhaseType)broadPhaseIndex);
+
         ImGui::End();
 
         float minVal, maxVal;
@@ -262,6 +271,31 @@
                 ImGui::Text("Calls : %d", data.callCount);
 
             }
+
+            const PairCache &pairs = world.getPairCache();
+            ImGui::Separator();
+            ImGui::Text("Cached pairs : %d (+%d / -%d)", pairs.getPairCount(), pairs.getAddedCount(), pairs.getRemovedCount());
+
+            const NarrowPhaseStats &narrow = world.getNarrowPhaseStats();
+            ImGui::Text("Narrow pairs : %d", narrow.pairs);
+            ImGui::Text("Bounding culled : %d", narrow.boundingCulled);
+            ImGui::Text("Shape tests : %d -> %d contacts", narrow.shapeTests, narrow.contacts);
+
+            ImGui::SliderInt("Solver iterations", &world.contactSolver.iterations, 1, 30);
+            ImGui::Checkbox("Warm starting", &world.contactSolver.warmStarting);
+
+            if (BVHTree *bvh = dynamic_cast<BVHTree *>(&world.getBroadPhase()))
+            {
+                ImGui::Separator();
+
+                static const char *buildModeNames[] = {"Median", "Binned SAH", "LBVH"};
+                int buildModeIndex = (int)bvh->buildMode;
+                if (ImGui::Combo("Build", &buildModeIndex, buildModeNames, IM_ARRAYSIZE(buildModeNames)))
+                    bvh->buildMode = (BVHBuildMode)buildModeIndex;
+
+                ImGui::Text("SAH cost : %.2f", bvh->computeSAHCost());
+                ImGui::Text("Overlap tests : %d", bvh->getOverlapTests());
+            }
         }
         ImGui::End();
 
@@ -454,34 +488,58 @@
 
     void Game::gradBodies(float mx, float my)
     {
-        for (auto *b : bodies)
+        if (eraserActive)
+        {
+            eraseAt(mx, my);
+            return;
+        }
+
+        Vector2 mouse(mx, my);
+        if (RigidBody *b = pickBody(mouse))
+        {
+            grabbed = b;
+            grabOffset = b->position - mouse;
+        }
+    }
+
+    RigidBody *Game::pickBody(const Vector2 &point)
+    {
+        // static bodies are the level geometry, they are neither dragged nor erased
+        RigidBody *hit = nullptr;
+        world.queryPoint(point, [&](RigidBody *b)
         {
             if (b->inverseMass == 0.0f)
-                continue; // static bodies not draggable
+                return true;
 
-            if (b->shapeType == ShapeType::AABB)
-            {
-                if (mx >= b->position.x - b->aabb.halfSize.x &&
-                    mx <= b->position.x + b->aabb.halfSize.x &&
-                    my >= b->position.y - b->aabb.halfSize.y &&
-                    my <= b->position.y + b->aabb.halfSize.y)
-                {
-                    grabbed = b;
-                    grabOffset = b->position - Vector2(mx, my);
-                    break;
-                }
-            }
-            else if (b->shapeType == ShapeType::CIRCLE)
-            {
-                Vector2 d = b->position - Vector2(mx, my);
-                if (d.magnitude() <= b->circle.radius)
-                {
-                    grabbed = b;
-                    grabOffset = d;
-                    break;
-                }
-            }
+            hit = b;
+            return false;
+        });
+
+        if (hit)
+            return hit;
+
+        // queryPoint never reports bodies with collision disabled, those few are checked by hand
+        for (RigidBody *b : bodies)
+        {
+            if (!b->enableCollision && b->inverseMass != 0.0f && NarrowCollision::PointInBody(point, b))
+                return b;
         }
+        return nullptr;
+    }
+
+    void Game::eraseAt(float mx, float my)
+    {
+        RigidBody *hit = pickBody(Vector2(mx, my));
+        if (!hit)
+            return;
+
+        // demos may still point at the body and its joints, so they are only taken out, not freed
+        world.removeBody(hit);
+        registry.remove(hit);
+        std::erase(bodies, hit);
+
+        if (grabbed == hit)
+            grabbed = nullptr;
     }
 
     void Game::cameraControls(const SDL_KeyboardEvent &e)